@@ -28,6 +28,48 @@ typedef struct SSiloMemorySpec
     uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node on which to allocate the memory.
 } SSiloMemorySpec;
 
+/// Enumerates the objectives that can be used to automatically lay out a multi-node array.
+typedef enum ESiloPartitionGoal
+{
+    SiloPartitionGoalBalancedByProcessors,                                  ///< Size of each piece is proportional to the number of processors on its NUMA node.
+    SiloPartitionGoalBalancedByFreeMemory,                                  ///< Size of each piece is proportional to the free memory on its NUMA node.
+    SiloPartitionGoalMinimumNodeCount,                                      ///< Use as few NUMA nodes as possible, filling those with the most free memory first.
+} ESiloPartitionGoal;
+
+/// Enumerates the possible outcomes of checking whether page-colored allocation is available.
+typedef enum ESiloColoringStatus
+{
+    SiloColoringStatusAvailable,                                            ///< Page-colored allocation can be used.
+    SiloColoringStatusUnsupportedPlatform,                                  ///< The operating system does not expose physical page addresses to applications.
+    SiloColoringStatusNoCacheInformation,                                   ///< The geometry of the last-level cache could not be determined, or the cache is too small to have more than one color.
+    SiloColoringStatusNoPhysicalAddressAccess,                              ///< The process lacks the privilege needed to read physical page addresses. On Linux this requires the CAP_SYS_ADMIN capability.
+} ESiloColoringStatus;
+
+/// Enumerates the access-pattern and lifecycle hints that can be applied to a range of memory.
+/// Each hint replaces any earlier hint of the same kind for the same range.
+typedef enum ESiloMemoryHint
+{
+    SiloMemoryHintNormal,                                                   ///< No particular access pattern. Cancels #SiloMemoryHintSequential and #SiloMemoryHintRandom.
+    SiloMemoryHintSequential,                                               ///< Accessed sequentially, so aggressive read-ahead is worthwhile and pages may be reclaimed soon after use.
+    SiloMemoryHintRandom,                                                   ///< Accessed randomly, so read-ahead is not worthwhile.
+    SiloMemoryHintWillNeed,                                                 ///< Will be accessed soon, so the contents should be brought into memory ahead of time.
+    SiloMemoryHintCold,                                                     ///< Unlikely to be accessed soon, so should be among the first to be reclaimed under memory pressure. Contents are preserved.
+    SiloMemoryHintPageOut,                                                  ///< Not needed for the foreseeable future, so should be reclaimed now. Contents are preserved.
+    SiloMemoryHintDontDump,                                                 ///< Exclude from core dumps.
+    SiloMemoryHintDump,                                                     ///< Include in core dumps. Cancels #SiloMemoryHintDontDump.
+    SiloMemoryHintLargePages,                                               ///< Back with large pages where possible, regardless of the size of the allocation.
+    SiloMemoryHintNoLargePages,                                             ///< Do not back with large pages, regardless of the size of the allocation.
+    SiloMemoryHintLock,                                                     ///< Keep resident in physical memory. Subject to the operating system's limit on locked memory.
+    SiloMemoryHintUnlock,                                                   ///< Allow to be paged out again. Cancels #SiloMemoryHintLock.
+} ESiloMemoryHint;
+
+/// Enumerates the ways in which the physical memory behind a range can be released.
+typedef enum ESiloReleaseMode
+{
+    SiloReleaseModeImmediate,                                               ///< Release now. The range reads as zero-filled afterwards.
+    SiloReleaseModeLazy,                                                    ///< Release only once the system needs the memory. Until the range is written, its contents are undefined and may be either the old data or zero-filled.
+} ESiloReleaseMode;
+
 
 // -------- FUNCTIONS ------------------------------------------------------ //
 #ifdef __cplusplus
@@ -59,6 +101,38 @@ void* siloSimpleBufferAlloc(size_t size, uint32_t numaNode);
 /// @return Pointer to the start of the allocated buffer, or NULL on allocation failure.
 void* siloSimpleBufferAllocLocal(size_t size);
 
+/// Allocates multiple simple virtually-contiguous buffers, each on a single NUMA node, in one call.
+/// Each buffer behaves exactly as if it had been allocated by siloSimpleBufferAlloc() and may be freed individually using siloFree() or together with others using siloFreeBatch().
+/// Requests are grouped by NUMA node so that far fewer operating system calls are needed than when allocating each buffer separately.
+/// Either all of the buffers are allocated or none of them are.
+/// When tracing, each buffer is recorded as a separate call to siloSimpleBufferAlloc().
+/// @param [in] count Number of buffers to allocate.
+/// @param [in] specs Size and NUMA node of each buffer to allocate. Sizes must be non-zero.
+/// @param [out] outPtrs Filled with a pointer to the start of each allocated buffer, in the same order as `specs`. Every element is set to NULL on failure.
+/// @return 0 if all of the buffers were allocated, or a negative value if any NUMA node index is out of range or on allocation failure.
+int32_t siloAllocBatch(uint32_t count, const SSiloMemorySpec* specs, void** outPtrs);
+
+/// Allocates a small object on a single NUMA node.
+/// Intended for large numbers of objects too small to justify a dedicated simple buffer each, such as hash table entries or graph vertices.
+/// Objects are carved out of large node-local chunks and cached per thread, so most calls neither enter the operating system nor take a lock.
+/// Memory obtained for small objects is retained for reuse and not returned to the operating system.
+/// Objects allocated by this function must be freed using siloFreeSmall(), not siloFree().
+/// @param [in] size Number of bytes to allocate, no more than 32768.
+/// @param [in] numaNode Zero-based index of the NUMA node on which to allocate the memory.
+/// @return Pointer to the start of the allocated object, aligned to at least 16 bytes, or NULL on allocation failure or if `size` is too large.
+void* siloMalloc(size_t size, uint32_t numaNode);
+
+/// Allocates a small object on the NUMA node on which the calling thread is currently executing.
+/// Otherwise identical to siloMalloc().
+/// @param [in] size Number of bytes to allocate, no more than 32768.
+/// @return Pointer to the start of the allocated object, aligned to at least 16 bytes, or NULL on allocation failure or if `size` is too large.
+void* siloMallocLocal(size_t size);
+
+/// Deallocates a small object allocated using siloMalloc() or siloMallocLocal().
+/// The object may be freed by any thread, regardless of which thread allocated it or on which NUMA node. It is always returned to the NUMA node that backs it.
+/// @param [in] ptr Pointer to the start of the object which should be deallocated. May be NULL, in which case nothing happens.
+void siloFreeSmall(void* ptr);
+
 /// Allocates a multi-node array, whose dimensions are specified piecewise.
 /// The result is a virtually-contiguous memory buffer potentially physically backed by different NUMA nodes.
 /// NUMA awareness can be achieved without adding an additional software indirection step, relying instead on hardware memory address translation.
@@ -70,11 +144,181 @@ void* siloSimpleBufferAllocLocal(size_t size);
 /// @return Pointer to the start of the allocated buffer, or NULL on allocation failure.
 void* siloMultinodeArrayAlloc(uint32_t count, const SSiloMemorySpec* spec);
 
+/// Creates a multi-node array that can be shared with other processes on the same system.
+/// The array is backed by a named shared memory object and is laid out exactly as siloMultinodeArrayAlloc() would lay it out.
+/// Each piece is bound to its NUMA node at the level of the shared object, so its memory is allocated once on that node no matter how many processes map it.
+/// Other processes can map the same array using siloSharedMultinodeArrayAttach().
+/// The mapping in this process is released by calling siloFree(), and the name is removed by calling siloSharedMultinodeArrayUnlink().
+/// Not currently supported on Windows.
+/// @param [in] name Name of the shared array, which must be non-empty and must not already exist.
+/// @param [in] count Number of pieces of the array to allocate.
+/// @param [in] spec Pointer to an array of specifications, each of which fully determines a piece of the multi-node array.
+/// @return Pointer to the start of the shared array, or NULL on failure.
+void* siloSharedMultinodeArrayCreate(const char* name, uint32_t count, const SSiloMemorySpec* spec);
+
+/// Maps a multi-node array previously created using siloSharedMultinodeArrayCreate() into the calling process.
+/// No data are copied. The mapping is released by calling siloFree().
+/// Not currently supported on Windows.
+/// @param [in] name Name of the shared array, which must be non-empty.
+/// @param [out] size Filled with the size of the array, in bytes. May be NULL.
+/// @return Pointer to the start of the shared array, or NULL on failure.
+void* siloSharedMultinodeArrayAttach(const char* name, size_t* size);
+
+/// Retrieves the piece-wise layout of a shared multi-node array.
+/// Piece sizes are the actual sizes allocated, after rounding to the allocation granularity.
+/// Not currently supported on Windows.
+/// @param [in] name Name of the shared array, which must be non-empty.
+/// @param [in] maxCount Maximum number of piece specifications to write to `spec`.
+/// @param [out] spec Filled with up to `maxCount` piece specifications. May be NULL if `maxCount` is 0.
+/// @return Total number of pieces in the array, or 0 on failure.
+uint32_t siloSharedMultinodeArrayGetLayout(const char* name, uint32_t maxCount, SSiloMemorySpec* spec);
+
+/// Removes the name of a shared multi-node array so that no further processes can attach to it.
+/// Processes that already have the array mapped are unaffected, and the memory is released once all of them have called siloFree().
+/// Not currently supported on Windows.
+/// @param [in] name Name of the shared array, which must be non-empty.
+/// @return 0 if the name was removed, or a negative value on failure.
+int32_t siloSharedMultinodeArrayUnlink(const char* name);
+
+/// Synchronously collapses a buffer or multi-node array allocated using Silo into large pages.
+/// By default the operating system backs eligible memory with large pages lazily, so small pages may remain in use for some time after allocation.
+/// This function blocks until the operating system has attempted the collapse and may therefore take a long time for large buffers.
+/// @param [in] ptr Pointer to the start of the allocated buffer, as returned by one of Silo's memory allocation functions.
+/// @return 0 if the entire buffer was collapsed, or a negative value if the buffer is unknown to Silo or the operating system does not support or could not complete the collapse.
+int32_t siloCollapseLargePages(void* ptr);
+
+/// Determines how many bytes of a buffer or multi-node array allocated using Silo are currently backed by large pages.
+/// Useful for verifying that large-page support is actually taking effect.
+/// On Linux the result is exact only for processes permitted to read physical page information, which normally requires the CAP_SYS_ADMIN capability.
+/// For other processes it is an upper bound: the operating system reports large-page usage per mapping, and buffers that are adjacent in memory, including all buffers from one siloAllocBatch() call, may share a mapping.
+/// @param [in] ptr Pointer to the start of the allocated buffer, as returned by one of Silo's memory allocation functions.
+/// @return Number of bytes backed by large pages, which is 0 if the buffer is unknown to Silo or the information is unavailable.
+size_t siloGetLargePageBackedSize(void* ptr);
+
+/// Allocates a multi-node array whose layout is chosen automatically.
+/// Reads the current free memory and processor count of each NUMA node in `nodeMask` and distributes the array among them according to `goal`.
+/// Each node keeps a safety margin of 1/16 of its free memory or 64MB, whichever is larger, for the page cache, the kernel, and the array's own page tables, which makes it unlikely that any piece spills onto another node.
+/// Free memory is only a snapshot, however, and pages are allocated when first touched, so memory consumed elsewhere in the meantime can still cause a spill.
+/// If the requested goal would place more memory on a node than it can accommodate, that node is filled and the excess is redistributed among the others.
+/// @param [in] size Total number of bytes to allocate.
+/// @param [in] nodeMask Bit mask of zero-based NUMA node indices that may be used. Bits beyond the number of NUMA nodes in the system are ignored.
+/// @param [in] goal Objective used to distribute memory among the NUMA nodes.
+/// @param [out] count Filled with the number of pieces in the chosen layout. May be NULL.
+/// @param [out] spec Filled with the chosen layout, one element per piece in ascending NUMA node order. Must have room for at least as many elements as bits set in `nodeMask`. May be NULL.
+/// @return Pointer to the start of the allocated buffer, or NULL if the nodes do not have enough free memory or on allocation failure.
+void* siloMultinodeArrayAllocAuto(size_t size, uint64_t nodeMask, ESiloPartitionGoal goal, uint32_t* count, SSiloMemorySpec* spec);
+
+/// Determines whether page-colored allocation can be used by the calling process.
+/// Page coloring partitions the last-level cache in software: each physical page maps to one group of cache sets, its color, so buffers built only from pages of disjoint colors conflict less with each other in the cache.
+/// This is useful for reducing interference between latency-critical work and other work sharing the same processor package.
+/// Many processors divide the last-level cache into slices selected by an undisclosed hash of the physical address, in which case colors reduce conflicts rather than eliminating them.
+/// @return #SiloColoringStatusAvailable if page-colored allocation can be used, or the reason it cannot.
+ESiloColoringStatus siloColoringGetStatus(void);
+
+/// Produces a human-readable explanation of a page-coloring status code, suitable for reporting to users.
+/// @param [in] status Status code returned by siloColoringGetStatus().
+/// @return Description of the status. Never NULL.
+const char* siloColoringGetStatusDescription(ESiloColoringStatus status);
+
+/// Retrieves the number of page colors that can be requested.
+/// The number is derived from the size and associativity of the whole last-level cache, so on processors whose cache is divided into hashed slices it can exceed the number of colors each slice actually distinguishes, and restricting a buffer to N colors then confines it less tightly than N divided by this value of the cache.
+/// On Linux the detected value can be overridden by setting the `SILO_COLOR_COUNT` environment variable to the number of colors per slice, which is the size of one way of one slice divided by the page size.
+/// @return Number of colors, which is a power of two no greater than 64, or 0 if page-colored allocation is unavailable.
+uint32_t siloColoringGetColorCount(void);
+
+/// Reserves memory on a NUMA node for later use by siloColoredBufferAlloc().
+/// The memory is allocated, locked in physical memory, and classified by color immediately, so reservation is slow and should be done ahead of time.
+/// Reserved memory is retained for reuse and not returned to the operating system.
+/// Pages are assigned colors by the physical address, so the amount of each color that a reservation yields is roughly, but not exactly, equal.
+/// @param [in] numaNode Zero-based index of the NUMA node on which to reserve memory.
+/// @param [in] size Number of bytes to reserve.
+/// Reserved memory counts against the locked-memory resource limit (RLIMIT_MEMLOCK), which by default is small for unprivileged processes.
+/// @return 0 if the memory was reserved, -2 if it could not be locked in physical memory, usually because the locked-memory limit is too low, or -1 if page-colored allocation is unavailable, the NUMA node index is out of range, or on allocation failure. Nothing is reserved on failure.
+int32_t siloColoredPoolReserve(uint32_t numaNode, size_t size);
+
+/// Determines how much reserved memory of the specified colors is not currently part of a colored buffer.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] colorMask Bit mask of colors to consider. Bits beyond the number of colors are ignored.
+/// @return Number of bytes available, which is 0 if page-colored allocation is unavailable.
+size_t siloColoredPoolGetFreeSize(uint32_t numaNode, uint64_t colorMask);
+
+/// Allocates a virtually-contiguous buffer whose pages all have one of the specified colors, using memory previously reserved on the specified NUMA node.
+/// Pages are used in rotation across the requested colors, so the buffer spreads evenly across the corresponding parts of the last-level cache.
+/// Pages are moved into place in runs of pages that were adjacent in the reserved memory, and each run becomes a separate memory mapping.
+/// Mappings count against a per-process operating system limit (on Linux, `vm.max_map_count`), so requests that would need more than 16384 of them fail, and this function is intended for buffers of modest size, such as the working set of a latency-critical task.
+/// The contents of the buffer are not necessarily zero-filled.
+/// Free the buffer using siloFree(), which returns its pages to the reserved memory.
+/// @param [in] size Number of bytes to allocate.
+/// @param [in] numaNode Zero-based index of the NUMA node whose reserved memory should be used.
+/// @param [in] colorMask Bit mask of colors that may be used. Bits beyond the number of colors are ignored.
+/// @return Pointer to the start of the allocated buffer, or NULL if page-colored allocation is unavailable, not enough memory of the requested colors has been reserved, or the buffer would need too many mappings.
+void* siloColoredBufferAlloc(size_t size, uint32_t numaNode, uint64_t colorMask);
+
+/// Applies an access-pattern or lifecycle hint to a range of memory allocated by Silo.
+/// Allows different parts of a buffer, such as the pieces of a multi-node array, to be treated differently, rather than relying on the defaults Silo chooses for the buffer as a whole.
+/// The range is widened to whole pages. Hints never change the contents of memory or the NUMA node that backs it.
+/// Not all hints are supported on all platforms. On Windows only #SiloMemoryHintWillNeed, #SiloMemoryHintPageOut, #SiloMemoryHintLock, and #SiloMemoryHintUnlock are supported.
+/// @param [in] ptr Pointer to the start of the range.
+/// @param [in] size Number of bytes in the range.
+/// @param [in] hint Hint to apply.
+/// @return 0 if the hint was applied, or a negative value if it is not supported or the operating system rejected it.
+int32_t siloApplyHint(void* ptr, size_t size, ESiloMemoryHint hint);
+
+/// Releases the physical memory behind a range of memory allocated by Silo, keeping the range allocated.
+/// The virtual address range stays valid and keeps its NUMA node binding, so it can be filled again later and will be backed by the same NUMA node without any further action.
+/// Only pages that lie entirely within the range are released. Locked pages cannot be released.
+/// Memory in a shared multi-node array is always released immediately, and the range reads as zero-filled in every process that maps the array.
+/// Must not be used on colored buffers or small objects.
+/// Immediate release is not supported on Windows.
+/// @param [in] ptr Pointer to the start of the range.
+/// @param [in] size Number of bytes in the range.
+/// @param [in] mode Indicates whether the memory should be released immediately or only once the system needs it. Lazy release is cheaper if the range will be filled again soon.
+/// @return 0 if the memory was released, or a negative value if the requested mode is not supported or the operating system rejected the request.
+int32_t siloRelease(void* ptr, size_t size, ESiloReleaseMode mode);
+
+/// Locates a single piece of a multi-node array, for use with siloApplyHint() or siloRelease().
+/// Works for arrays allocated by siloMultinodeArrayAlloc() or siloMultinodeArrayAllocAuto() and for shared multi-node arrays, using the layout Silo recorded when the array was allocated or attached.
+/// @param [in] ptr Pointer to the start of the multi-node array.
+/// @param [in] pieceIndex Zero-based index of the piece of interest, in the order in which the pieces were specified.
+/// @param [out] pieceStart Filled with a pointer to the start of the piece. Must not be NULL.
+/// @param [out] pieceSize Filled with the actual size of the piece, in bytes, which may be 0 if the piece was too small to receive any memory. Must not be NULL.
+/// @return 0 on success, or a negative value if `ptr` is not the start of a multi-node array known to Silo, `pieceIndex` is out of range, or either output pointer is NULL.
+int32_t siloMultinodeArrayGetPiece(void* ptr, uint32_t pieceIndex, void** pieceStart, size_t* pieceSize);
+
+/// Applies a separate hint to each piece of a multi-node array.
+/// Equivalent to calling siloMultinodeArrayGetPiece() and then siloApplyHint() for each piece.
+/// @param [in] ptr Pointer to the start of the multi-node array.
+/// @param [in] count Number of elements in `hints`, which must equal the number of pieces in the array.
+/// @param [in] hints Hint to apply to each piece, one element per piece.
+/// @return 0 if every hint was applied, or a negative value if `ptr` is not the start of a multi-node array known to Silo, `count` does not match its number of pieces, or any hint could not be applied.
+int32_t siloMultinodeArrayApplyHints(void* ptr, uint32_t count, const ESiloMemoryHint* hints);
+
 /// Deallocates memory allocated using Silo.
 /// Only call this function with addresses returned by Silo's memory allocation functions.
 /// @param [in] ptr Pointer to the start of the allocated buffer which should be deallocated.
 void siloFree(void* ptr);
 
+/// Deallocates multiple buffers in one call.
+/// Equivalent to calling siloFree() on each element of `ptrs`, but buffers that are adjacent in memory, such as those allocated together by siloAllocBatch(), are released together.
+/// When tracing, each buffer is recorded as a separate call to siloFree().
+/// @param [in] count Number of buffers to deallocate.
+/// @param [in] ptrs Pointers to the start of each buffer which should be deallocated, as returned by Silo's memory allocation functions. NULL elements are ignored.
+void siloFreeBatch(uint32_t count, void* const* ptrs);
+
+/// Starts recording every call to Silo's allocation and deallocation functions to a compact binary trace file, replacing its contents.
+/// Each record captures the operation, requested size and NUMA node(s), calling thread and the NUMA node on which it was executing, and the time spent in the call.
+/// The trace can be analyzed and replayed using the `silo-replay` tool.
+/// Any trace already in progress is stopped first.
+/// Tracing can also be started without modifying the application by setting the `SILO_TRACE_FILE` environment variable to the path of the trace file.
+/// Colored buffers and shared multi-node arrays are not traced, nor are frees of buffers allocated while tracing was stopped.
+/// @param [in] path Path of the file to which to write the trace.
+/// @return 0 if tracing started, or a negative value if the file could not be opened.
+int32_t siloTraceStart(const char* path);
+
+/// Stops recording and closes the trace file, if a trace is in progress.
+/// Any trace still in progress when the program exits is closed automatically.
+void siloTraceStop(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file colormemory.h
+ *   Declaration of page-colored allocation, which restricts buffers to a subset of the sets in the last-level cache.
+ *   Pages are reserved ahead of time, classified by the physical address bits that select last-level cache sets, and handed out by color.
+ *   Not intended for external use.
+ *****************************************************************************/
+
+#pragma once
+
+#include "../silo.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Maximum number of page colors distinguished, so that a set of colors fits in a 64-bit mask.
+/// Caches with more colors than this are treated as having exactly this many, each covering several of the cache's own colors.
+static const uint32_t kSiloColorMaximumCount = 64;
+
+/// Maximum number of separate memory mappings that a single colored buffer may occupy.
+/// Each run of pages that were not already adjacent in the pool occupies its own mapping, and mappings are a limited per-process resource (on Linux, `vm.max_map_count`, 65530 by default).
+/// Requests that would need more mappings than this fail rather than exhaust the limit for the rest of the process.
+static const size_t kSiloColorMaximumMappingsPerBuffer = 16384;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Enumerates the possible outcomes of reserving memory for colored allocation.
+enum ESiloColorReserveResult
+{
+    SiloColorReserveResultSuccess,                                          ///< The memory was reserved.
+    SiloColorReserveResultFailure,                                          ///< Coloring is unavailable, the node is invalid, or memory could not be allocated.
+    SiloColorReserveResultCannotLock,                                       ///< The memory could not be locked in physical memory, usually because of the locked-memory resource limit.
+};
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Determines whether page-colored allocation can be used by the calling process.
+/// The result is computed on first use and does not change afterwards.
+/// This is a platform-specific operation.
+/// @return Status code indicating either availability or the reason coloring is unavailable.
+ESiloColoringStatus siloColorMemoryGetStatus(void);
+
+/// Retrieves the number of page colors that are distinguished.
+/// This is a platform-specific operation.
+/// @return Number of colors, which is a power of two no greater than #kSiloColorMaximumCount, or 0 if coloring is unavailable.
+uint32_t siloColorMemoryGetColorCount(void);
+
+/// Reserves memory on the specified NUMA node and adds its pages to that node's pool of colored pages.
+/// Reserved memory is faulted in and locked immediately so that the physical address, and therefore the color, of each page is known and stays fixed.
+/// If the memory cannot be locked, nothing is reserved, because unlocked pages may later be moved to frames of different colors.
+/// This is a platform-specific operation.
+/// @param [in] size Number of bytes to reserve, rounded up to a whole number of pages.
+/// @param [in] numaNode Zero-based index of the NUMA node on which to reserve memory.
+/// @return Result code indicating success or the reason for failure.
+ESiloColorReserveResult siloColorMemoryReserve(size_t size, uint32_t numaNode);
+
+/// Determines how much reserved memory of the specified colors is available on the specified NUMA node.
+/// This is a platform-specific operation.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] colorMask Bit mask of colors to consider.
+/// @return Number of bytes available.
+size_t siloColorMemoryGetFreeSize(uint32_t numaNode, uint64_t colorMask);
+
+/// Allocates a virtually-contiguous buffer made up only of pages of the specified colors, taken from the specified NUMA node's pool.
+/// Pages are used in rotation across the requested colors so that the buffer spreads evenly over the corresponding cache sets.
+/// Pages that were adjacent in the pool are moved together, so the buffer occupies one mapping per run of such pages, up to #kSiloColorMaximumMappingsPerBuffer.
+/// This is a platform-specific operation.
+/// @param [in] size Number of bytes to allocate.
+/// @param [in] numaNode Zero-based index of the NUMA node whose pool should be used.
+/// @param [in] colorMask Bit mask of colors that may be used.
+/// @return Pointer to the start of the allocated buffer, or NULL if the pool does not hold enough pages of the requested colors, the buffer would need too many mappings, or on failure.
+void* siloColorMemoryAlloc(size_t size, uint32_t numaNode, uint64_t colorMask);
+
+/// Returns the pages of a buffer allocated by siloColorMemoryAlloc() to the pool from which they came.
+/// This is a platform-specific operation.
+/// @param [in] ptr Pointer to the start of the buffer.
+/// @return `true` if the buffer was freed, `false` if it was not allocated by siloColorMemoryAlloc().
+bool siloColorMemoryFree(void* ptr);
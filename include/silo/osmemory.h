@@ -15,8 +15,10 @@
 #pragma once
 
 #include "../silo.h"
+#include "pointermap.h"
 
 #include <cstdint>
+#include <vector>
 
 
 // -------- FUNCTIONS ------------------------------------------------------ //
@@ -33,6 +35,23 @@ size_t siloOSMemoryGetGranularity(bool useLargePageSupport);
 /// @return OS identifier of the bound NUMA node, or negative in the event of an error.
 int32_t siloOSMemoryGetNUMANodeForVirtualAddress(void* address);
 
+/// Retrieves the NUMA node on which the calling thread is currently executing.
+/// This is a platform-specific operation.
+/// @return OS index of the NUMA node, or negative in the event of an error.
+int32_t siloOSMemoryGetCurrentNUMANode(void);
+
+/// Retrieves the amount of memory currently free on the specified NUMA node.
+/// This is a platform-specific operation.
+/// @param [in] numaNode OS-specific index of the NUMA node to query.
+/// @return Number of free bytes, or 0 in the event of an error.
+size_t siloOSMemoryGetNUMANodeFreeSize(uint32_t numaNode);
+
+/// Retrieves the number of logical processors that belong to the specified NUMA node.
+/// This is a platform-specific operation.
+/// @param [in] numaNode OS-specific index of the NUMA node to query.
+/// @return Number of logical processors, or 0 in the event of an error.
+uint32_t siloOSMemoryGetNUMANodeProcessorCount(uint32_t numaNode);
+
 /// Rounds the provided allocation size to the nearest multiple of the system's allocation granularity.
 /// This is a platform-independent operation.
 /// @param [in] unroundedSize Unrounded size, in bytes.
@@ -45,13 +64,36 @@ size_t siloOSMemoryRoundAllocationSize(size_t unroundedSize, bool useLargePageSu
 /// @return `true` if large page support should automatically be turned on, `false` otherwise.
 bool siloOSMemoryShouldAutoEnableLargePageSupport(size_t unroundedSize);
 
+/// Computes the actual size of each piece of a multi-node array from its piece-wise specification.
+/// Each piece is rounded to the nearest multiple of the allocation granularity, and the last piece is extended as needed to cover the total requested size.
+/// Also verifies that each specified NUMA node exists.
+/// This is a platform-independent operation.
+/// @param [in] count Number of pieces of the array.
+/// @param [in] spec Pointer to an array of specifications, each of which fully determines a piece of the multi-node array.
+/// @param [out] actualBytes Filled with the actual size, in bytes, of each piece.
+/// @param [out] useLargePageSupport Filled with `true` if large-page support should be used for the array, `false` otherwise.
+/// @return Total actual size of the array, or 0 if any NUMA node is invalid or no piece is large enough to result in non-zero allocation units.
+size_t siloOSMemoryComputeMultiNUMAPieceSizes(uint32_t count, const SSiloMemorySpec* spec, std::vector<size_t>* actualBytes, bool* useLargePageSupport);
+
 /// Allocates a memory buffer on the specified NUMA node.
+/// If large-page support is automatically enabled for the requested size, the returned address is aligned to the large-page granularity, even if the buffer ends up backed by small pages.
 /// This is a platform-specific operation.
 /// @param [in] size Number of bytes to allocate.
 /// @param [in] numaNode OS-specific index of the NUMA node on which to allocate the memory.
 /// @return Pointer to the start of the allocated buffer, or NULL on allocation failure.
 void* siloOSMemoryAllocNUMA(size_t size, uint32_t numaNode);
 
+/// Allocates multiple memory buffers on the specified NUMA node.
+/// Each buffer is laid out and aligned exactly as if it had been allocated by siloOSMemoryAllocNUMA() and may be freed individually using siloOSMemoryFreeNUMA(), but the platform may obtain them all at once.
+/// Either all of the buffers are allocated or none of them are.
+/// This is a platform-specific operation.
+/// @param [in] count Number of buffers to allocate.
+/// @param [in] sizes Number of bytes to allocate for each buffer.
+/// @param [in] numaNode OS-specific index of the NUMA node on which to allocate the memory.
+/// @param [out] ptrs Filled with a pointer to the start of each allocated buffer.
+/// @return `true` if all buffers were allocated, `false` otherwise.
+bool siloOSMemoryAllocNUMABatch(uint32_t count, const size_t* sizes, uint32_t numaNode, void** ptrs);
+
 /// Alloctes a memory buffer on the calling thread's current NUMA node.
 /// This is a platform-specific operation.
 /// @param [in] size Number of bytes to allocate.
@@ -70,3 +112,45 @@ void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec);
 /// @param [in] ptr Pointer to the start of the allocated buffer which should be deallocated.
 /// @param [in] size Number of bytes originally allocated.
 void siloOSMemoryFreeNUMA(void* ptr, size_t size);
+
+/// Deallocates multiple memory buffers, each of which could otherwise have been passed to siloOSMemoryFreeNUMA().
+/// The platform may release buffers that are adjacent in the virtual address space together.
+/// This is a platform-specific operation.
+/// @param [in] count Number of buffers to deallocate.
+/// @param [in] specs Pointer to the start of each buffer and the number of bytes originally allocated for it.
+void siloOSMemoryFreeNUMABatch(uint32_t count, const SSiloAllocationSpec* specs);
+
+/// Synchronously collapses the specified memory region into large pages, rather than waiting for the operating system to do so in the background.
+/// This is a platform-specific operation.
+/// @param [in] ptr Pointer to the start of the memory region.
+/// @param [in] size Number of bytes originally allocated.
+/// @return `true` if the operating system collapsed the region, `false` otherwise.
+bool siloOSMemoryCollapseLargePages(void* ptr, size_t size);
+
+/// Determines how many bytes of the specified memory region are currently backed by large pages.
+/// On Linux the exact value requires access to physical page information, which is normally restricted to privileged processes.
+/// Otherwise the value is an upper bound derived from per-mapping statistics, which may include large pages that belong to neighbouring buffers in the same mapping.
+/// This is a platform-specific operation.
+/// @param [in] ptr Pointer to the start of the memory region.
+/// @param [in] size Number of bytes originally allocated.
+/// @return Number of bytes backed by large pages, which is 0 if the information is unavailable.
+size_t siloOSMemoryGetLargePageBackedSize(void* ptr, size_t size);
+
+/// Passes an access-pattern or lifecycle hint for the specified memory region to the operating system.
+/// The region is widened to whole pages, since hints do not change the contents of memory.
+/// This is a platform-specific operation.
+/// @param [in] ptr Pointer to the start of the memory region.
+/// @param [in] size Number of bytes in the memory region.
+/// @param [in] hint Hint to apply.
+/// @return `true` if the hint was applied, `false` if the operating system does not support it or rejected it.
+bool siloOSMemoryApplyHint(void* ptr, size_t size, ESiloMemoryHint hint);
+
+/// Returns the physical memory backing the specified memory region to the operating system, keeping the virtual address range and its NUMA node binding intact.
+/// The region is narrowed to the pages that lie entirely within it, so that data outside the region is never discarded.
+/// Memory shared between processes is released from the shared object itself, immediately, regardless of the requested mode.
+/// This is a platform-specific operation.
+/// @param [in] ptr Pointer to the start of the memory region.
+/// @param [in] size Number of bytes in the memory region.
+/// @param [in] mode Indicates whether the memory should be released immediately or only once the system needs it.
+/// @return `true` if the memory was released, `false` if the operating system does not support the requested mode or rejected the request.
+bool siloOSMemoryRelease(void* ptr, size_t size, ESiloReleaseMode mode);
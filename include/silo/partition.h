@@ -0,0 +1,35 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file partition.h
+ *   Declaration of helpers for automatically partitioning multi-node arrays.
+ *   Not intended for external use.
+ *****************************************************************************/
+
+#pragma once
+
+#include "../silo.h"
+
+#include <cstdint>
+#include <vector>
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Chooses a piece-wise layout for a multi-node array of the specified total size.
+/// Queries the operating system for the current amount of free memory and the number of processors on each candidate NUMA node.
+/// Each piece in the resulting layout is an exact multiple of the allocation granularity that will be used to allocate the array and fits within the free memory of its node, less a safety margin of 1/16 of that memory or 64MB, whichever is larger.
+/// Pieces are ordered by ascending NUMA node index, and nodes that receive no memory are omitted.
+/// This is a platform-independent operation.
+/// @param [in] size Total number of bytes to allocate.
+/// @param [in] nodeMask Bit mask of zero-based NUMA node indices that may be used.
+/// @param [in] goal Objective used to distribute memory among the candidate NUMA nodes.
+/// @param [out] plan Filled with the chosen layout. Left empty on failure.
+/// @return `true` if a layout satisfying the request was found, `false` otherwise.
+bool siloPartitionPlan(size_t size, uint64_t nodeMask, ESiloPartitionGoal goal, std::vector<SSiloMemorySpec>* plan);
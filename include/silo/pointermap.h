@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include "../silo.h"
+
 #include <cstdlib>
 #include <cstdint>
 #include <vector>
@@ -41,6 +43,27 @@ struct SSiloAllocationSpec
 /// @return Pointer to the newly-created vector containing the allocation specifications, or `NULL` if there was an error adding the address to the map.
 const std::vector<SSiloAllocationSpec>* siloPointerMapSubmit(uint32_t count, const SSiloAllocationSpec* specs);
 
+/// Submits multiple independent single-piece allocations to the pointer map at once.
+/// Equivalent to calling siloPointerMapSubmit() with a `count` of 1 for each element of `specs`, except that either all of them are added or none of them are.
+/// @param [in] count Number of allocations to add.
+/// @param [in] specs Address and size specifications for each allocation.
+/// @return `true` if all of the allocations were added, or `false` if any base address already exists in the map, in which case the map is unchanged.
+bool siloPointerMapSubmitBatch(uint32_t count, const SSiloAllocationSpec* specs);
+
+/// Records the piece-wise layout of a multi-node array whose allocation has already been submitted to the pointer map.
+/// The layout is kept separately from the allocation specifications, which describe only what must be freed, and is removed along with them.
+/// @param [in] ptr Base address of the multi-node array.
+/// @param [in] count Number of pieces in the array.
+/// @param [in] pieces Actual size and NUMA node of each piece, in order.
+/// @return `true` if the layout was recorded, or `false` if the base address does not exist in the map or already has a layout.
+bool siloPointerMapSubmitLayout(void* ptr, uint32_t count, const SSiloMemorySpec* pieces);
+
+/// Retrieves a copy of the piece-wise layout of a multi-node array.
+/// @param [in] ptr Base address of the multi-node array.
+/// @param [out] pieces Filled with the actual size and NUMA node of each piece, in order.
+/// @return `true` if a layout was found, or `false` if the address does not exist in the map or is not the base of a multi-node array.
+bool siloPointerMapRetrieveLayout(void* ptr, std::vector<SSiloMemorySpec>* pieces);
+
 /// Retrieves information about a set of memory addresses from the pointer map, all of which correspond to a single allocation.
 /// The base address must be specified as a parameter.
 /// Note that the returned vector is not removed from the map, but can be accessed in a read-only manner.
@@ -52,3 +75,11 @@ const std::vector<SSiloAllocationSpec>* siloPointerMapRetrieve(void* ptr);
 /// Intended to be called once the allocation has been freed by the application.
 /// @param [in] ptr Base address for the allocation of interest.
 void siloPointerMapDelete(void* ptr);
+
+/// Destroys the mapping information associated with multiple base addresses at once and reports what was removed.
+/// Intended to be called just before the allocations are freed by the application.
+/// @param [in] count Number of base addresses.
+/// @param [in] ptrs Base addresses for the allocations of interest. NULL elements are ignored.
+/// @param [out] removedSpecs Appended with the allocation specifications of every piece of every allocation that was removed.
+/// @param [out] unknownPtrs Appended with each base address that does not exist in the map.
+void siloPointerMapDeleteBatch(uint32_t count, void* const* ptrs, std::vector<SSiloAllocationSpec>* removedSpecs, std::vector<void*>* unknownPtrs);
@@ -0,0 +1,56 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file sharedmemory.h
+ *   Declaration of helpers for multi-node arrays shared between processes.
+ *   Not intended for external use.
+ *****************************************************************************/
+
+#pragma once
+
+#include "../silo.h"
+
+#include <cstdint>
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Creates a named shared memory object holding a multi-node array and maps it into the calling process.
+/// Piece sizes are determined exactly as for a private multi-node array, and each piece is bound to its NUMA node at the level of the shared object, so pages are placed correctly no matter which process first touches them.
+/// The layout is stored within the object so that other processes can attach to it.
+/// On success, the mapped array is submitted to the pointer map.
+/// This is a platform-specific operation.
+/// @param [in] name Name of the shared memory object, which must be non-empty and must not already exist.
+/// @param [in] count Number of pieces of the array to allocate.
+/// @param [in] spec Pointer to an array of specifications, each of which fully determines a piece of the multi-node array.
+/// @return Pointer to the start of the mapped array, or NULL on failure.
+void* siloSharedMemoryCreateMultiNUMA(const char* name, uint32_t count, const SSiloMemorySpec* spec);
+
+/// Maps an existing named multi-node array into the calling process.
+/// On success, the mapped array is submitted to the pointer map.
+/// This is a platform-specific operation.
+/// @param [in] name Name of the shared memory object, which must be non-empty.
+/// @param [out] size Filled with the size of the mapped array, in bytes. May be NULL.
+/// @return Pointer to the start of the mapped array, or NULL on failure.
+void* siloSharedMemoryAttachMultiNUMA(const char* name, size_t* size);
+
+/// Reads the layout of an existing named multi-node array.
+/// This is a platform-specific operation.
+/// @param [in] name Name of the shared memory object, which must be non-empty.
+/// @param [in] maxCount Maximum number of piece specifications to write to `spec`.
+/// @param [out] spec Filled with up to `maxCount` piece specifications. May be NULL if `maxCount` is 0.
+/// @return Total number of pieces in the array, or 0 on failure.
+uint32_t siloSharedMemoryGetLayout(const char* name, uint32_t maxCount, SSiloMemorySpec* spec);
+
+/// Removes the name of a shared multi-node array so that no further processes can attach to it.
+/// The memory itself is released once every process has freed its mapping.
+/// This is a platform-specific operation.
+/// @param [in] name Name of the shared memory object, which must be non-empty.
+/// @return `true` if the name was removed, `false` otherwise.
+bool siloSharedMemoryUnlink(const char* name);
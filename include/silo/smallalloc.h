@@ -0,0 +1,48 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file smallalloc.h
+ *   Declaration of the NUMA-aware allocator for small objects.
+ *   Objects are carved out of large node-local chunks, grouped by size class, and cached per thread.
+ *   Not intended for external use.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Largest object size, in bytes, served by the small-object allocator.
+static const size_t kSiloSmallMaximumSize = 32768;
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Allocates a small object on the specified NUMA node.
+/// The object is taken from the calling thread's cache, which is refilled in batches from the node's central free lists.
+/// This is a platform-independent operation.
+/// @param [in] size Number of bytes to allocate, no more than #kSiloSmallMaximumSize.
+/// @param [in] numaNode Zero-based index of the NUMA node on which to allocate the object.
+/// @return Pointer to the allocated object, or NULL on failure.
+void* siloSmallAlloc(size_t size, uint32_t numaNode);
+
+/// Allocates a small object on the NUMA node on which the calling thread is currently executing.
+/// This is a platform-independent operation.
+/// @param [in] size Number of bytes to allocate, no more than #kSiloSmallMaximumSize.
+/// @return Pointer to the allocated object, or NULL on failure.
+void* siloSmallAllocLocal(size_t size);
+
+/// Frees a small object, which may have been allocated by any thread on any NUMA node.
+/// The object is returned to the calling thread's cache for its owning node, and the cache returns objects to the owning node's central free lists in batches.
+/// This is a platform-independent operation.
+/// @param [in] ptr Pointer to an object previously allocated by the small-object allocator.
+void siloSmallFree(void* ptr);
@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file trace.h
+ *   Declaration of the allocation tracer and its binary log format.
+ *   Used by the library to record calls and by the replay tool to read them back.
+ *   Not intended for external use.
+ *****************************************************************************/
+
+#pragma once
+
+#include "../silo.h"
+
+#include <cstdint>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Identifies a file as a Silo allocation trace. Written as the first 8 bytes of the file.
+static const uint64_t kSiloTraceMagic = 0x314352544f4c4953ull;
+
+/// Version of the trace format described in this file.
+static const uint32_t kSiloTraceVersion = 1;
+
+/// Value of the NUMA node field for operations that do not specify a node.
+static const uint32_t kSiloTraceNoNode = 0xffffffff;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Enumerates the operations that can appear in a trace.
+enum ESiloTraceOperation
+{
+    SiloTraceOperationSimpleBufferAlloc = 1,                                ///< siloSimpleBufferAlloc()
+    SiloTraceOperationSimpleBufferAllocLocal = 2,                           ///< siloSimpleBufferAllocLocal()
+    SiloTraceOperationMultinodeArrayAlloc = 3,                              ///< siloMultinodeArrayAlloc(), and siloMultinodeArrayAllocAuto() with its chosen layout.
+    SiloTraceOperationMalloc = 4,                                           ///< siloMalloc()
+    SiloTraceOperationMallocLocal = 5,                                      ///< siloMallocLocal()
+    SiloTraceOperationFree = 6,                                             ///< siloFree()
+    SiloTraceOperationFreeSmall = 7,                                        ///< siloFreeSmall()
+};
+
+/// Written once at the start of a trace file.
+struct SSiloTraceFileHeader
+{
+    uint64_t magic;                                                         ///< Set to #kSiloTraceMagic.
+    uint32_t version;                                                       ///< Set to #kSiloTraceVersion.
+    uint32_t reserved;                                                      ///< Unused, set to zero.
+};
+
+/// Describes a single call into Silo.
+/// Records appear in the order in which the calls completed, so a free always follows the allocation it releases.
+/// A multi-node array allocation record is followed immediately by `pieceCount` instances of #SSiloTracePiece.
+struct SSiloTraceRecord
+{
+    uint32_t operation;                                                     ///< Value from #ESiloTraceOperation.
+    uint32_t threadId;                                                      ///< Identifies the calling thread. Threads are numbered from 0 in the order in which they first appear.
+    uint32_t numaNode;                                                      ///< Requested NUMA node, or #kSiloTraceNoNode if the operation does not specify one.
+    int32_t threadNumaNode;                                                 ///< NUMA node on which the calling thread was executing, or negative if unknown.
+    uint32_t pieceCount;                                                    ///< Number of pieces that follow, for multi-node array allocations.
+    uint32_t reserved;                                                      ///< Unused, set to zero.
+    uint64_t size;                                                          ///< Requested size, in bytes. Zero for frees.
+    uint64_t pointerId;                                                     ///< Identifies the allocation, numbered from 1. Zero if an allocation failed. Frees of pointers whose allocations were not traced are not recorded.
+    uint64_t timestamp;                                                     ///< Time at which the call began, in nanoseconds since tracing started.
+    uint64_t duration;                                                      ///< Time spent in the call, in nanoseconds.
+};
+
+/// Describes a single piece of a traced multi-node array allocation.
+struct SSiloTracePiece
+{
+    uint64_t size;                                                          ///< Requested size of the piece, in bytes.
+    uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node requested for the piece.
+    uint32_t reserved;                                                      ///< Unused, set to zero.
+};
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Starts recording all Silo calls to the specified file, replacing its contents.
+/// Any trace already in progress is stopped first.
+/// @param [in] path Path of the file to which to write the trace.
+/// @return `true` if tracing started, `false` if the file could not be opened.
+bool siloTraceOpen(const char* path);
+
+/// Stops recording and closes the trace file, if a trace is in progress.
+void siloTraceClose(void);
+
+/// Captures the time at which a traced call begins.
+/// Intended to be passed to one of the recording functions once the call completes.
+/// @return Nanoseconds since tracing started, which is never 0, or 0 if tracing is not enabled.
+uint64_t siloTraceGetTimestamp(void);
+
+/// Records a completed allocation call.
+/// Does nothing if `startTimestamp` is 0, meaning tracing was not enabled when the call began.
+/// @param [in] operation Operation that was performed.
+/// @param [in] size Requested size, in bytes.
+/// @param [in] numaNode Requested NUMA node, or #kSiloTraceNoNode.
+/// @param [in] count Number of pieces, for multi-node array allocations, or 0 otherwise.
+/// @param [in] spec Piece specifications, for multi-node array allocations, or NULL otherwise.
+/// @param [in] result Pointer returned by the call.
+/// @param [in] startTimestamp Value returned by siloTraceGetTimestamp() when the call began.
+void siloTraceRecordAllocation(ESiloTraceOperation operation, size_t size, uint32_t numaNode, uint32_t count, const SSiloMemorySpec* spec, void* result, uint64_t startTimestamp);
+
+/// Stops tracking a pointer that is about to be freed and retrieves its identifier.
+/// Must be called before the memory is actually released, because afterwards the same address may be handed out again by another thread.
+/// Does nothing if `startTimestamp` is 0, meaning tracing was not enabled when the call began.
+/// @param [in] ptr Pointer that is about to be freed.
+/// @param [in] startTimestamp Value returned by siloTraceGetTimestamp() when the call began.
+/// @return Identifier of the allocation, or 0 if the pointer is unknown or tracing was not enabled.
+uint64_t siloTraceReleasePointerId(void* ptr, uint64_t startTimestamp);
+
+/// Records a completed free call.
+/// Does nothing if `startTimestamp` is 0, meaning tracing was not enabled when the call began, or if `pointerId` is 0, meaning the allocation being freed was not traced.
+/// @param [in] operation Operation that was performed.
+/// @param [in] pointerId Value returned by siloTraceReleasePointerId() for the pointer that was freed.
+/// @param [in] startTimestamp Value returned by siloTraceGetTimestamp() when the call began.
+void siloTraceRecordFree(ESiloTraceOperation operation, uint64_t pointerId, uint64_t startTimestamp);
@@ -0,0 +1,667 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file preload.cpp
+ *   Implementation of a C library allocator interposer for use with LD_PRELOAD.
+ *   Routes large allocations through Silo according to a policy read from the environment, leaving small allocations to the C library.
+ *   Every C library function that allocates heap memory or inspects a heap pointer is interposed, so that Silo buffers are never passed to the C library's allocator.
+ *   This file is Linux-specific and is built into its own shared library rather than into Silo itself.
+ *
+ *   The following environment variables are recognized.
+ *   - `SILO_PRELOAD_POLICY`: one of `local` (default), `node`, `interleave`, or `threadmap`.
+ *   - `SILO_PRELOAD_NODE`: zero-based NUMA node index used by the `node` policy. Defaults to 0.
+ *   - `SILO_PRELOAD_THREAD_NODES`: comma-separated list of NUMA node indices used by the `threadmap` policy. The Nth thread to allocate uses element N modulo the list length.
+ *   - `SILO_PRELOAD_THRESHOLD`: minimum size, in bytes, of a request that is routed through Silo. Defaults to 1048576.
+ *   - `SILO_PRELOAD_STATS`: set to 0 to suppress the summary printed to standard error at exit.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "osmemory.h"
+#include "pointermap.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <numa.h>
+#include <topo.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Default minimum size of a request that is routed through Silo.
+static const size_t kSiloPreloadDefaultThreshold = 1048576;
+
+/// Maximum number of NUMA nodes for which statistics are kept, and maximum length of the thread-to-node map.
+static const uint32_t kSiloPreloadMaxNodes = 64;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Enumerates the placement policies that can be applied to intercepted allocations.
+enum ESiloPreloadPolicy
+{
+    SiloPreloadPolicyLocal,                                                 ///< Allocate on the NUMA node of the calling thread.
+    SiloPreloadPolicyNode,                                                  ///< Allocate on a single fixed NUMA node.
+    SiloPreloadPolicyInterleave,                                            ///< Split each allocation into equal pieces, one per NUMA node, or interleave its pages if it is too small to split.
+    SiloPreloadPolicyThreadMap,                                             ///< Allocate on a NUMA node chosen by the order in which threads first allocate.
+};
+
+/// Sets the reentrancy flag for the calling thread for as long as it is in scope.
+/// Any allocation made while the flag is set, including those made internally by Silo and its dependencies, is passed straight to the C library.
+struct SSiloPreloadReentrancyGuard
+{
+    SSiloPreloadReentrancyGuard(void);
+    ~SSiloPreloadReentrancyGuard(void);
+};
+
+
+// -------- EXTERNAL DECLARATIONS ------------------------------------------ //
+
+// Entry points into the C library's own allocator, which remain reachable even though the public names are interposed.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+/// Signature of the C library's malloc_usable_size(), which has no internal entry point and must be looked up dynamically.
+typedef size_t (*TSiloPreloadUsableSizeFunc)(void* ptr);
+
+
+// -------- LOCALS --------------------------------------------------------- //
+
+/// Indicates that the configuration has been read and interception may begin.
+static bool siloPreloadIsInitialized = false;
+
+/// Placement policy read from the environment.
+static ESiloPreloadPolicy siloPreloadPolicy = SiloPreloadPolicyLocal;
+
+/// Minimum size of a request that is routed through Silo.
+static size_t siloPreloadThreshold = kSiloPreloadDefaultThreshold;
+
+/// NUMA node used by the fixed-node policy.
+static uint32_t siloPreloadNode = 0;
+
+/// Number of NUMA nodes in the system.
+static uint32_t siloPreloadNodeCount = 1;
+
+/// NUMA nodes used by the thread-map policy.
+static uint32_t siloPreloadThreadNodes[kSiloPreloadMaxNodes];
+
+/// Number of valid entries in #siloPreloadThreadNodes.
+static uint32_t siloPreloadThreadNodeCount = 0;
+
+/// Indicates that a summary should be printed at exit.
+static bool siloPreloadShouldPrintStats = true;
+
+/// System page size, used to quickly rule out pointers that Silo cannot have allocated.
+static size_t siloPreloadPageSize = 4096;
+
+/// C library implementation of malloc_usable_size().
+static TSiloPreloadUsableSizeFunc siloPreloadLibcUsableSize = NULL;
+
+/// Set while the calling thread is executing inside Silo or the C library on behalf of the interposer.
+static thread_local bool siloPreloadIsInsideSilo = false;
+
+/// Order in which the calling thread first allocated through Silo, or negative if it has not yet done so.
+static thread_local int32_t siloPreloadThreadIndex = -1;
+
+/// Next thread index to hand out.
+static std::atomic<int32_t> siloPreloadNextThreadIndex(0);
+
+/// Number of allocations routed through Silo.
+static std::atomic<uint64_t> siloPreloadStatSiloAllocations(0);
+
+/// Number of bytes routed through Silo.
+static std::atomic<uint64_t> siloPreloadStatSiloBytes(0);
+
+/// Number of bytes routed through Silo, broken down by NUMA node. Interleaved allocations are split according to their pieces, or evenly if their pages are interleaved.
+static std::atomic<uint64_t> siloPreloadStatNodeBytes[kSiloPreloadMaxNodes];
+
+/// Number of Silo allocations freed.
+static std::atomic<uint64_t> siloPreloadStatSiloFrees(0);
+
+/// Number of Silo allocations that failed and fell back to the C library.
+static std::atomic<uint64_t> siloPreloadStatFallbacks(0);
+
+/// Number of anonymous memory mappings to which the placement policy was applied.
+static std::atomic<uint64_t> siloPreloadStatBoundMappings(0);
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+SSiloPreloadReentrancyGuard::SSiloPreloadReentrancyGuard(void)
+{
+    siloPreloadIsInsideSilo = true;
+}
+
+// --------
+
+SSiloPreloadReentrancyGuard::~SSiloPreloadReentrancyGuard(void)
+{
+    siloPreloadIsInsideSilo = false;
+}
+
+// --------
+
+/// Determines if a request should be passed directly to the C library without further consideration.
+/// @return `true` if interception is not yet possible or the calling thread is already inside Silo, `false` otherwise.
+static inline bool siloPreloadShouldPassThrough(void)
+{
+    return ((false == siloPreloadIsInitialized) || (true == siloPreloadIsInsideSilo));
+}
+
+// --------
+
+/// Looks up the size of an allocation made through Silo.
+/// Must be called with the reentrancy guard held.
+/// @param [in] ptr Pointer to check.
+/// @return Size of the allocation, or 0 if Silo did not allocate `ptr`.
+static size_t siloPreloadGetSiloAllocationSize(void* ptr)
+{
+    // Silo allocations are always page-aligned, so most pointers can be ruled out without taking the pointer map lock.
+    if (0 != ((size_t)ptr & (siloPreloadPageSize - 1)))
+        return 0;
+
+    const std::vector<SSiloAllocationSpec>* allocationSpec = siloPointerMapRetrieve(ptr);
+    if (NULL == allocationSpec)
+        return 0;
+
+    size_t allocationSize = 0;
+
+    for (size_t i = 0; i < allocationSpec->size(); ++i)
+        allocationSize += (*allocationSpec)[i].size;
+
+    return allocationSize;
+}
+
+// --------
+
+/// Determines the NUMA node on which the calling thread is running.
+/// @return Zero-based NUMA node index, or -1 if it cannot be determined.
+static int32_t siloPreloadGetCurrentNUMANode(void)
+{
+    const int32_t numaNodeOSIndex = siloOSMemoryGetCurrentNUMANode();
+
+    for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+    {
+        if (numaNodeOSIndex == topoGetNUMANodeOSIndex(i))
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+// --------
+
+/// Determines the NUMA node on which the calling thread's allocations should be placed under the thread-map policy.
+/// @return Zero-based NUMA node index.
+static uint32_t siloPreloadGetThreadMapNode(void)
+{
+    if (0 > siloPreloadThreadIndex)
+        siloPreloadThreadIndex = siloPreloadNextThreadIndex++;
+
+    return siloPreloadThreadNodes[(uint32_t)siloPreloadThreadIndex % siloPreloadThreadNodeCount];
+}
+
+// --------
+
+/// Allocates memory through Silo and spreads it across all NUMA nodes.
+/// Requests large enough to give each node at least one allocation unit become multi-node arrays with one contiguous piece per node.
+/// Smaller requests are placed in a single buffer whose pages are interleaved across nodes, since splitting them would round some pieces away entirely.
+/// Must be called with the reentrancy guard held.
+/// @param [in] size Number of bytes to allocate.
+/// @return Pointer to the allocated buffer, or NULL on failure.
+static void* siloPreloadAllocInterleaved(size_t size)
+{
+    const size_t allocationUnitSize = siloOSMemoryGetGranularity(siloOSMemoryShouldAutoEnableLargePageSupport(size));
+    const size_t unitCount = (size + allocationUnitSize - 1) / allocationUnitSize;
+
+    if (unitCount < siloPreloadNodeCount)
+    {
+        void* allocatedBuffer = siloSimpleBufferAllocLocal(size);
+        if (NULL == allocatedBuffer)
+            return NULL;
+
+        numa_interleave_memory(allocatedBuffer, size, numa_all_nodes_ptr);
+
+        for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+            siloPreloadStatNodeBytes[i] += size / siloPreloadNodeCount;
+
+        return allocatedBuffer;
+    }
+
+    // Every piece but the last is a whole number of allocation units, so Silo does not round any of them to a different size.
+    // The last piece takes whatever remains, which is at least one unit because there are at least as many units as nodes.
+    const size_t pieceSize = ((unitCount / siloPreloadNodeCount) * allocationUnitSize);
+    SSiloMemorySpec pieces[kSiloPreloadMaxNodes];
+
+    for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+    {
+        pieces[i].size = pieceSize;
+        pieces[i].numaNode = i;
+    }
+
+    pieces[siloPreloadNodeCount - 1].size = size - (pieceSize * (siloPreloadNodeCount - 1));
+
+    void* allocatedBuffer = siloMultinodeArrayAlloc(siloPreloadNodeCount, pieces);
+    if (NULL == allocatedBuffer)
+        return NULL;
+
+    for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+        siloPreloadStatNodeBytes[i] += pieces[i].size;
+
+    return allocatedBuffer;
+}
+
+// --------
+
+/// Allocates memory through Silo according to the configured policy.
+/// Must be called with the reentrancy guard held.
+/// @param [in] size Number of bytes to allocate.
+/// @return Pointer to the allocated buffer, or NULL on failure.
+static void* siloPreloadAllocFromSilo(size_t size)
+{
+    void* allocatedBuffer = NULL;
+    int32_t statNode = -1;
+
+    switch (siloPreloadPolicy)
+    {
+    case SiloPreloadPolicyNode:
+        statNode = (int32_t)siloPreloadNode;
+        allocatedBuffer = siloSimpleBufferAlloc(size, siloPreloadNode);
+        break;
+
+    case SiloPreloadPolicyThreadMap:
+        statNode = (int32_t)siloPreloadGetThreadMapNode();
+        allocatedBuffer = siloSimpleBufferAlloc(size, (uint32_t)statNode);
+        break;
+
+    case SiloPreloadPolicyInterleave:
+        if (1 < siloPreloadNodeCount)
+        {
+            allocatedBuffer = siloPreloadAllocInterleaved(size);
+            break;
+        }
+
+        // With only one NUMA node, interleaving is the same as local allocation.
+        allocatedBuffer = siloSimpleBufferAllocLocal(size);
+        break;
+
+    default:
+        allocatedBuffer = siloSimpleBufferAllocLocal(size);
+        break;
+    }
+
+    if (NULL == allocatedBuffer)
+    {
+        siloPreloadStatFallbacks += 1;
+        return NULL;
+    }
+
+    // For local allocation the node is only known after the fact.
+    if ((SiloPreloadPolicyLocal == siloPreloadPolicy) || ((SiloPreloadPolicyInterleave == siloPreloadPolicy) && (1 == siloPreloadNodeCount)))
+        statNode = siloPreloadGetCurrentNUMANode();
+
+    siloPreloadStatSiloAllocations += 1;
+    siloPreloadStatSiloBytes += size;
+
+    if ((0 <= statNode) && ((uint32_t)statNode < kSiloPreloadMaxNodes))
+        siloPreloadStatNodeBytes[statNode] += size;
+
+    return allocatedBuffer;
+}
+
+// --------
+
+/// Allocates memory with the specified alignment, through Silo if possible and from the C library otherwise.
+/// @param [in] alignment Required alignment, which the C library may round up to a power of two.
+/// @param [in] size Number of bytes to allocate.
+/// @return Pointer to the allocated buffer, or NULL on failure.
+static void* siloPreloadAllocAligned(size_t alignment, size_t size)
+{
+    // Silo allocations are page-aligned, so only requests with at most page alignment can be routed through Silo.
+    if ((false == siloPreloadShouldPassThrough()) && (size >= siloPreloadThreshold) && (alignment <= siloPreloadPageSize))
+    {
+        SSiloPreloadReentrancyGuard reentrancyGuard;
+        void* allocatedBuffer = siloPreloadAllocFromSilo(size);
+
+        if (NULL != allocatedBuffer)
+            return allocatedBuffer;
+    }
+
+    return __libc_memalign(alignment, size);
+}
+
+// --------
+
+/// Applies the configured placement policy to a newly-created anonymous memory mapping.
+/// Must be called with the reentrancy guard held.
+/// @param [in] addr Start address of the mapping.
+/// @param [in] length Length of the mapping, in bytes.
+static void siloPreloadBindMapping(void* addr, size_t length)
+{
+    int32_t numaNodeOSIndex = -1;
+
+    switch (siloPreloadPolicy)
+    {
+    case SiloPreloadPolicyNode:
+        numaNodeOSIndex = topoGetNUMANodeOSIndex(siloPreloadNode);
+        break;
+
+    case SiloPreloadPolicyThreadMap:
+        numaNodeOSIndex = topoGetNUMANodeOSIndex(siloPreloadGetThreadMapNode());
+        break;
+
+    case SiloPreloadPolicyInterleave:
+        numa_interleave_memory(addr, length, numa_all_nodes_ptr);
+        siloPreloadStatBoundMappings += 1;
+        return;
+
+    default:
+        // The kernel already places pages on the node of the thread that first touches them.
+        return;
+    }
+
+    if (0 <= numaNodeOSIndex)
+    {
+        numa_tonode_memory(addr, length, numaNodeOSIndex);
+        siloPreloadStatBoundMappings += 1;
+    }
+}
+
+// --------
+
+/// Reads the interposer configuration from the environment.
+/// Runs automatically when the library is loaded. Until it has run, every request is passed to the C library.
+__attribute__((constructor)) static void siloPreloadInitialize(void)
+{
+    SSiloPreloadReentrancyGuard reentrancyGuard;
+
+    siloPreloadPageSize = (size_t)sysconf(_SC_PAGESIZE);
+    siloPreloadLibcUsableSize = (TSiloPreloadUsableSizeFunc)dlsym(RTLD_NEXT, "malloc_usable_size");
+    siloPreloadNodeCount = topoGetSystemNUMANodeCount();
+
+    if ((0 == siloPreloadNodeCount) || (kSiloPreloadMaxNodes < siloPreloadNodeCount))
+        siloPreloadNodeCount = (0 == siloPreloadNodeCount ? 1 : kSiloPreloadMaxNodes);
+
+    const char* policyString = getenv("SILO_PRELOAD_POLICY");
+    if (NULL != policyString)
+    {
+        if (0 == strcmp(policyString, "node"))
+            siloPreloadPolicy = SiloPreloadPolicyNode;
+        else if (0 == strcmp(policyString, "interleave"))
+            siloPreloadPolicy = SiloPreloadPolicyInterleave;
+        else if (0 == strcmp(policyString, "threadmap"))
+            siloPreloadPolicy = SiloPreloadPolicyThreadMap;
+        else
+            siloPreloadPolicy = SiloPreloadPolicyLocal;
+    }
+
+    const char* nodeString = getenv("SILO_PRELOAD_NODE");
+    if (NULL != nodeString)
+        siloPreloadNode = (uint32_t)strtoul(nodeString, NULL, 0);
+
+    const char* threadNodesString = getenv("SILO_PRELOAD_THREAD_NODES");
+    while ((NULL != threadNodesString) && ('\0' != *threadNodesString) && (siloPreloadThreadNodeCount < kSiloPreloadMaxNodes))
+    {
+        char* parseEnd = NULL;
+        const unsigned long parsedNode = strtoul(threadNodesString, &parseEnd, 0);
+
+        if (parseEnd == threadNodesString)
+            break;
+
+        siloPreloadThreadNodes[siloPreloadThreadNodeCount++] = (uint32_t)parsedNode;
+        threadNodesString = ((',' == *parseEnd) ? parseEnd + 1 : parseEnd);
+    }
+
+    // Without a thread map, fall back to round-robin assignment of threads to nodes.
+    if ((SiloPreloadPolicyThreadMap == siloPreloadPolicy) && (0 == siloPreloadThreadNodeCount))
+    {
+        for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+            siloPreloadThreadNodes[siloPreloadThreadNodeCount++] = i;
+    }
+
+    const char* thresholdString = getenv("SILO_PRELOAD_THRESHOLD");
+    if (NULL != thresholdString)
+        siloPreloadThreshold = (size_t)strtoull(thresholdString, NULL, 0);
+
+    const char* statsString = getenv("SILO_PRELOAD_STATS");
+    if ((NULL != statsString) && (0 == strcmp(statsString, "0")))
+        siloPreloadShouldPrintStats = false;
+
+    siloPreloadIsInitialized = true;
+}
+
+// --------
+
+/// Prints a summary of the interposer's activity to standard error.
+/// Runs automatically when the library is unloaded, normally at program exit.
+__attribute__((destructor)) static void siloPreloadPrintStats(void)
+{
+    if (false == siloPreloadShouldPrintStats)
+        return;
+
+    SSiloPreloadReentrancyGuard reentrancyGuard;
+    static const char* const kPolicyNames[] = {"local", "node", "interleave", "threadmap"};
+
+    fprintf(stderr, "silo-preload: process %d, policy=%s threshold=%llu\n", (int)getpid(), kPolicyNames[siloPreloadPolicy], (unsigned long long)siloPreloadThreshold);
+    fprintf(stderr, "silo-preload: %llu allocations (%llu bytes) through Silo, %llu freed, %llu fell back to the C library\n", (unsigned long long)siloPreloadStatSiloAllocations.load(), (unsigned long long)siloPreloadStatSiloBytes.load(), (unsigned long long)siloPreloadStatSiloFrees.load(), (unsigned long long)siloPreloadStatFallbacks.load());
+    fprintf(stderr, "silo-preload: %llu anonymous mappings bound\n", (unsigned long long)siloPreloadStatBoundMappings.load());
+
+    for (uint32_t i = 0; i < siloPreloadNodeCount; ++i)
+        fprintf(stderr, "silo-preload: node %u: %llu bytes\n", i, (unsigned long long)siloPreloadStatNodeBytes[i].load());
+}
+
+
+// -------- INTERPOSED FUNCTIONS ------------------------------------------- //
+// See the C library documentation for the contract of each function.
+
+extern "C" void* malloc(size_t size)
+{
+    if ((true == siloPreloadShouldPassThrough()) || (size < siloPreloadThreshold))
+        return __libc_malloc(size);
+
+    SSiloPreloadReentrancyGuard reentrancyGuard;
+    void* allocatedBuffer = siloPreloadAllocFromSilo(size);
+
+    return ((NULL != allocatedBuffer) ? allocatedBuffer : __libc_malloc(size));
+}
+
+// --------
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    const size_t totalSize = count * size;
+
+    if ((true == siloPreloadShouldPassThrough()) || ((0 != size) && ((totalSize / size) != count)) || (totalSize < siloPreloadThreshold))
+        return __libc_calloc(count, size);
+
+    // Memory freshly allocated by Silo is already zero-filled.
+    SSiloPreloadReentrancyGuard reentrancyGuard;
+    void* allocatedBuffer = siloPreloadAllocFromSilo(totalSize);
+
+    return ((NULL != allocatedBuffer) ? allocatedBuffer : __libc_calloc(count, size));
+}
+
+// --------
+
+extern "C" void free(void* ptr)
+{
+    if ((NULL == ptr) || (true == siloPreloadShouldPassThrough()) || (0 != ((size_t)ptr & (siloPreloadPageSize - 1))))
+    {
+        __libc_free(ptr);
+        return;
+    }
+
+    SSiloPreloadReentrancyGuard reentrancyGuard;
+
+    if (0 != siloPreloadGetSiloAllocationSize(ptr))
+    {
+        siloFree(ptr);
+        siloPreloadStatSiloFrees += 1;
+    }
+    else
+    {
+        __libc_free(ptr);
+    }
+}
+
+// --------
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    if (NULL == ptr)
+        return malloc(size);
+
+    if (true == siloPreloadShouldPassThrough())
+        return __libc_realloc(ptr, size);
+
+    size_t oldSize = 0;
+
+    {
+        SSiloPreloadReentrancyGuard reentrancyGuard;
+        oldSize = siloPreloadGetSiloAllocationSize(ptr);
+    }
+
+    if (0 == oldSize)
+    {
+        // Buffers owned by the C library stay there unless they grow past the threshold.
+        if (size < siloPreloadThreshold)
+            return __libc_realloc(ptr, size);
+
+        oldSize = ((NULL != siloPreloadLibcUsableSize) ? siloPreloadLibcUsableSize(ptr) : 0);
+    }
+    else if ((0 != size) && (size <= oldSize) && (size >= siloPreloadThreshold))
+    {
+        // Shrinking a Silo buffer that remains above the threshold is done in place.
+        return ptr;
+    }
+
+    if (0 == size)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    void* reallocatedBuffer = malloc(size);
+    if (NULL == reallocatedBuffer)
+        return NULL;
+
+    memcpy(reallocatedBuffer, ptr, (oldSize < size ? oldSize : size));
+    free(ptr);
+
+    return reallocatedBuffer;
+}
+
+// --------
+
+extern "C" int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    if ((0 == alignment) || (0 != (alignment & (alignment - 1))) || (0 != (alignment % sizeof(void*))))
+        return EINVAL;
+
+    void* allocatedBuffer = siloPreloadAllocAligned(alignment, size);
+    if (NULL == allocatedBuffer)
+        return ENOMEM;
+
+    *memptr = allocatedBuffer;
+    return 0;
+}
+
+// --------
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    return siloPreloadAllocAligned(alignment, size);
+}
+
+// --------
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    if (0 != (alignment & (alignment - 1)))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return siloPreloadAllocAligned(alignment, size);
+}
+
+// --------
+
+extern "C" void* valloc(size_t size)
+{
+    return siloPreloadAllocAligned(siloPreloadPageSize, size);
+}
+
+// --------
+
+extern "C" void* pvalloc(size_t size)
+{
+    // The size is rounded up to a whole number of pages, and a request for nothing still receives one page.
+    const size_t roundedSize = ((0 == size) ? siloPreloadPageSize : ((size + siloPreloadPageSize - 1) & ~(siloPreloadPageSize - 1)));
+
+    if (roundedSize < size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return siloPreloadAllocAligned(siloPreloadPageSize, roundedSize);
+}
+
+// --------
+
+extern "C" size_t malloc_usable_size(void* ptr)
+{
+    if (NULL == ptr)
+        return 0;
+
+    if ((false == siloPreloadShouldPassThrough()) && (0 == ((size_t)ptr & (siloPreloadPageSize - 1))))
+    {
+        SSiloPreloadReentrancyGuard reentrancyGuard;
+        const size_t allocationSize = siloPreloadGetSiloAllocationSize(ptr);
+
+        if (0 != allocationSize)
+            return allocationSize;
+    }
+
+    return ((NULL != siloPreloadLibcUsableSize) ? siloPreloadLibcUsableSize(ptr) : 0);
+}
+
+// --------
+
+extern "C" void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    void* result = (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+
+    // Only private anonymous mappings made directly by the application are subject to the placement policy.
+    if ((MAP_FAILED != result) && (false == siloPreloadShouldPassThrough()) && (length >= siloPreloadThreshold) && (MAP_ANONYMOUS == (flags & (MAP_ANONYMOUS | MAP_SHARED))))
+    {
+        SSiloPreloadReentrancyGuard reentrancyGuard;
+        siloPreloadBindMapping(result, length);
+    }
+
+    return result;
+}
+
+// --------
+
+extern "C" void* mmap64(void* addr, size_t length, int prot, int flags, int fd, off_t offset) __attribute__((alias("mmap")));
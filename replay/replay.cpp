@@ -0,0 +1,594 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file replay.cpp
+ *   Implementation of a tool that analyzes and replays allocation traces.
+ *   Reports per-operation latency distributions, peak memory requested on each NUMA node, and how accurately the replayed allocations were placed.
+ *   This file is Linux-specific and is built into its own executable rather than into Silo itself.
+ *
+ *   Usage: `silo-replay [options] trace-file`
+ *   - `--free-running`: let each thread proceed at its own pace, only waiting for an allocation to complete before freeing it. By default operations are replayed one at a time in the order in which they were recorded.
+ *   - `--no-placement`: do not check the NUMA node of each replayed allocation.
+ *   - `--analyze-only`: report on the trace without replaying it.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "osmemory.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <numa.h>
+#include <thread>
+#include <topo.h>
+#include <vector>
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Holds a single operation read from a trace, along with the outcome of replaying it.
+struct SSiloReplayOperation
+{
+    SSiloTraceRecord record;                                                ///< Record as read from the trace.
+    std::vector<SSiloMemorySpec> pieces;                                    ///< Piece specifications, for multi-node array allocations.
+    uint64_t replayDuration;                                                ///< Time spent in the replayed call, in nanoseconds.
+    bool wasReplayed;                                                       ///< Indicates that the operation was replayed.
+    uint32_t placementChecked;                                              ///< Number of pieces whose NUMA node was checked.
+    uint32_t placementCorrect;                                              ///< Number of checked pieces that were on the expected NUMA node.
+};
+
+/// Holds the outcome of each allocation being replayed, indexed by pointer identifier.
+struct SSiloReplayPointer
+{
+    std::atomic<void*> ptr;                                                 ///< Pointer returned by the replayed allocation.
+    std::atomic<bool> isReady;                                              ///< Set once the replayed allocation has completed, whether or not it succeeded.
+};
+
+
+// -------- LOCALS --------------------------------------------------------- //
+
+/// All operations in the trace, in the order in which they were recorded.
+static std::vector<SSiloReplayOperation> siloReplayOperations;
+
+/// Indices of the operations performed by each traced thread, in order.
+static std::vector<std::vector<size_t>> siloReplayThreadOperations;
+
+/// Replayed allocations, indexed by pointer identifier.
+static std::unique_ptr<SSiloReplayPointer[]> siloReplayPointers;
+
+/// Index of the next operation to replay when operations are replayed in order.
+static std::atomic<size_t> siloReplayNextOperation(0);
+
+/// Indicates that threads should proceed independently rather than in recorded order.
+static bool siloReplayIsFreeRunning = false;
+
+/// Indicates that the NUMA node of each replayed allocation should be checked.
+static bool siloReplayShouldCheckPlacement = true;
+
+/// Human-readable names of each operation, indexed by #ESiloTraceOperation.
+static const char* const siloReplayOperationNames[] = {"(unknown)", "siloSimpleBufferAlloc", "siloSimpleBufferAllocLocal", "siloMultinodeArrayAlloc", "siloMalloc", "siloMallocLocal", "siloFree", "siloFreeSmall"};
+
+/// Number of entries in #siloReplayOperationNames.
+static const uint32_t siloReplayOperationNameCount = sizeof(siloReplayOperationNames) / sizeof(siloReplayOperationNames[0]);
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Determines if an operation allocates memory.
+/// @param [in] operation Operation to check.
+/// @return `true` if the operation is an allocation, `false` otherwise.
+static inline bool siloReplayIsAllocation(uint32_t operation)
+{
+    return ((SiloTraceOperationFree != operation) && (SiloTraceOperationFreeSmall != operation));
+}
+
+// --------
+
+/// Reads an entire trace file into memory.
+/// @param [in] path Path of the trace file.
+/// @return Largest pointer identifier in the trace, or 0 if there are none. Negative if the file could not be read.
+static int64_t siloReplayLoadTrace(const char* path)
+{
+    FILE* traceFile = fopen(path, "rb");
+    if (NULL == traceFile)
+    {
+        fprintf(stderr, "silo-replay: unable to open %s\n", path);
+        return -1;
+    }
+
+    SSiloTraceFileHeader fileHeader;
+    if ((1 != fread(&fileHeader, sizeof(fileHeader), 1, traceFile)) || (kSiloTraceMagic != fileHeader.magic) || (kSiloTraceVersion != fileHeader.version))
+    {
+        fprintf(stderr, "silo-replay: %s is not a supported Silo trace\n", path);
+        fclose(traceFile);
+        return -1;
+    }
+
+    uint64_t maxPointerId = 0;
+    SSiloReplayOperation operation;
+    memset(&operation.record, 0, sizeof(operation.record));
+    operation.replayDuration = 0;
+    operation.wasReplayed = false;
+    operation.placementChecked = 0;
+    operation.placementCorrect = 0;
+
+    while (1 == fread(&operation.record, sizeof(operation.record), 1, traceFile))
+    {
+        operation.pieces.resize(operation.record.pieceCount);
+
+        for (uint32_t i = 0; i < operation.record.pieceCount; ++i)
+        {
+            SSiloTracePiece piece;
+
+            if (1 != fread(&piece, sizeof(piece), 1, traceFile))
+            {
+                // A trace cut short, for example because the program crashed, ends with a partial record.
+                fprintf(stderr, "silo-replay: ignoring truncated record at the end of %s\n", path);
+                operation.record.operation = 0;
+                break;
+            }
+
+            operation.pieces[i].size = (size_t)piece.size;
+            operation.pieces[i].numaNode = piece.numaNode;
+        }
+
+        if ((0 == operation.record.operation) || (siloReplayOperationNameCount <= operation.record.operation))
+            break;
+
+        if (siloReplayThreadOperations.size() <= operation.record.threadId)
+            siloReplayThreadOperations.resize(operation.record.threadId + 1);
+
+        siloReplayThreadOperations[operation.record.threadId].push_back(siloReplayOperations.size());
+        siloReplayOperations.push_back(operation);
+
+        if (maxPointerId < operation.record.pointerId)
+            maxPointerId = operation.record.pointerId;
+    }
+
+    fclose(traceFile);
+    return (int64_t)maxPointerId;
+}
+
+// --------
+
+/// Binds the calling thread to the specified NUMA node.
+/// @param [in] numaNode Zero-based index of the NUMA node, or negative to leave the thread unbound.
+static void siloReplayBindThread(int32_t numaNode)
+{
+    if (0 > numaNode)
+        return;
+
+    const int32_t numaNodeOSIndex = topoGetNUMANodeOSIndex((uint32_t)numaNode);
+
+    if (0 <= numaNodeOSIndex)
+        numa_run_on_node(numaNodeOSIndex);
+}
+
+// --------
+
+/// Checks whether an address is backed by the expected NUMA node and updates the operation's placement counts.
+/// @param [in] address Address to check.
+/// @param [in] numaNode Zero-based index of the NUMA node that should back the address.
+/// @param [in,out] operation Operation whose placement counts should be updated.
+static void siloReplayCheckAddress(void* address, uint32_t numaNode, SSiloReplayOperation* operation)
+{
+    const int32_t expectedOSIndex = topoGetNUMANodeOSIndex(numaNode);
+
+    operation->placementChecked += 1;
+
+    if ((0 <= expectedOSIndex) && (expectedOSIndex == siloGetNUMANodeForVirtualAddress(address)))
+        operation->placementCorrect += 1;
+}
+
+// --------
+
+/// Checks whether a replayed allocation was placed on the NUMA node or nodes that were requested.
+/// Local allocations are expected to be on the NUMA node to which the replaying thread was bound.
+/// @param [in] allocatedBuffer Pointer returned by the replayed allocation.
+/// @param [in,out] operation Operation that was replayed.
+static void siloReplayCheckPlacement(void* allocatedBuffer, SSiloReplayOperation* operation)
+{
+    const SSiloTraceRecord& record = operation->record;
+
+    switch (record.operation)
+    {
+    case SiloTraceOperationSimpleBufferAlloc:
+    case SiloTraceOperationMalloc:
+        siloReplayCheckAddress(allocatedBuffer, record.numaNode, operation);
+        break;
+
+    case SiloTraceOperationSimpleBufferAllocLocal:
+    case SiloTraceOperationMallocLocal:
+        if (0 <= record.threadNumaNode)
+            siloReplayCheckAddress(allocatedBuffer, (uint32_t)record.threadNumaNode, operation);
+        break;
+
+    case SiloTraceOperationMultinodeArrayAlloc:
+        {
+            // Reproduce the layout Silo chose so that the start of each piece can be located.
+            std::vector<size_t> actualBytes;
+            bool useLargePageSupport = false;
+
+            if (0 == siloOSMemoryComputeMultiNUMAPieceSizes((uint32_t)operation->pieces.size(), &operation->pieces[0], &actualBytes, &useLargePageSupport))
+                break;
+
+            size_t pieceOffset = 0;
+
+            for (size_t i = 0; i < actualBytes.size(); ++i)
+            {
+                if (0 != actualBytes[i])
+                    siloReplayCheckAddress((uint8_t*)allocatedBuffer + pieceOffset, operation->pieces[i].numaNode, operation);
+
+                pieceOffset += actualBytes[i];
+            }
+        }
+        break;
+    }
+}
+
+// --------
+
+/// Performs a single operation and measures the time it takes.
+/// @param [in,out] operation Operation to perform.
+static void siloReplayPerformOperation(SSiloReplayOperation* operation)
+{
+    const SSiloTraceRecord& record = operation->record;
+    SSiloReplayPointer* pointer = ((0 != record.pointerId) ? &siloReplayPointers[record.pointerId] : NULL);
+
+    if (false == siloReplayIsAllocation(record.operation))
+    {
+        // Nothing can be replayed for a free of a pointer that the trace does not identify.
+        if (NULL == pointer)
+            return;
+
+        // In free-running mode the allocation may not yet have been replayed by its own thread.
+        while (false == pointer->isReady.load(std::memory_order_acquire))
+            std::this_thread::yield();
+
+        void* ptrToFree = pointer->ptr.load(std::memory_order_relaxed);
+        if (NULL == ptrToFree)
+            return;
+
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        if (SiloTraceOperationFreeSmall == record.operation)
+            siloFreeSmall(ptrToFree);
+        else
+            siloFree(ptrToFree);
+
+        operation->replayDuration = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        operation->wasReplayed = true;
+        return;
+    }
+
+    void* allocatedBuffer = NULL;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    switch (record.operation)
+    {
+    case SiloTraceOperationSimpleBufferAlloc:
+        allocatedBuffer = siloSimpleBufferAlloc((size_t)record.size, record.numaNode);
+        break;
+
+    case SiloTraceOperationSimpleBufferAllocLocal:
+        allocatedBuffer = siloSimpleBufferAllocLocal((size_t)record.size);
+        break;
+
+    case SiloTraceOperationMultinodeArrayAlloc:
+        if (false == operation->pieces.empty())
+            allocatedBuffer = siloMultinodeArrayAlloc((uint32_t)operation->pieces.size(), &operation->pieces[0]);
+        break;
+
+    case SiloTraceOperationMalloc:
+        allocatedBuffer = siloMalloc((size_t)record.size, record.numaNode);
+        break;
+
+    case SiloTraceOperationMallocLocal:
+        allocatedBuffer = siloMallocLocal((size_t)record.size);
+        break;
+    }
+
+    operation->replayDuration = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    operation->wasReplayed = true;
+
+    if ((NULL != allocatedBuffer) && (true == siloReplayShouldCheckPlacement))
+        siloReplayCheckPlacement(allocatedBuffer, operation);
+
+    if (NULL != pointer)
+    {
+        pointer->ptr.store(allocatedBuffer, std::memory_order_relaxed);
+        pointer->isReady.store(true, std::memory_order_release);
+    }
+    else if (NULL != allocatedBuffer)
+    {
+        // The allocation failed when it was traced, so nothing will free it later.
+        if ((SiloTraceOperationMalloc == record.operation) || (SiloTraceOperationMallocLocal == record.operation))
+            siloFreeSmall(allocatedBuffer);
+        else
+            siloFree(allocatedBuffer);
+    }
+}
+
+// --------
+
+/// Replays all of the operations performed by a single traced thread.
+/// @param [in] threadId Identifier of the traced thread.
+static void siloReplayThreadMain(uint32_t threadId)
+{
+    const std::vector<size_t>& operationIndices = siloReplayThreadOperations[threadId];
+    int32_t boundNumaNode = -1;
+
+    for (size_t i = 0; i < operationIndices.size(); ++i)
+    {
+        const size_t operationIndex = operationIndices[i];
+        SSiloReplayOperation& operation = siloReplayOperations[operationIndex];
+
+        // Follow the traced thread as it moves between NUMA nodes.
+        if ((0 <= operation.record.threadNumaNode) && (boundNumaNode != operation.record.threadNumaNode))
+        {
+            boundNumaNode = operation.record.threadNumaNode;
+            siloReplayBindThread(boundNumaNode);
+        }
+
+        if (false == siloReplayIsFreeRunning)
+        {
+            while (operationIndex != siloReplayNextOperation.load(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+
+        siloReplayPerformOperation(&operation);
+
+        if (false == siloReplayIsFreeRunning)
+            siloReplayNextOperation.store(operationIndex + 1, std::memory_order_release);
+    }
+}
+
+// --------
+
+/// Computes a percentile of a sorted set of samples using the nearest-rank method.
+/// @param [in] samples Sorted samples, which must not be empty.
+/// @param [in] percentile Percentile to compute, between 0 and 100.
+/// @return Value of the requested percentile.
+static uint64_t siloReplayGetPercentile(const std::vector<uint64_t>& samples, double percentile)
+{
+    size_t rank = (size_t)((percentile / 100.0) * (double)samples.size() + 0.999999);
+
+    if (0 == rank)
+        rank = 1;
+
+    return samples[std::min(rank, samples.size()) - 1];
+}
+
+// --------
+
+/// Prints one row of the latency table.
+/// @param [in] operationName Name of the operation.
+/// @param [in] sourceName Name of the source of the samples.
+/// @param [in,out] samples Latency samples, in nanoseconds. Sorted by this function.
+static void siloReplayPrintLatencyRow(const char* operationName, const char* sourceName, std::vector<uint64_t>& samples)
+{
+    if (true == samples.empty())
+        return;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sampleSum = 0.0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        sampleSum += (double)samples[i];
+
+    printf("%-28s %-7s %10llu %12.0f %10llu %10llu %10llu %10llu %12llu\n", operationName, sourceName, (unsigned long long)samples.size(), sampleSum / (double)samples.size(), (unsigned long long)siloReplayGetPercentile(samples, 50.0), (unsigned long long)siloReplayGetPercentile(samples, 90.0), (unsigned long long)siloReplayGetPercentile(samples, 99.0), (unsigned long long)siloReplayGetPercentile(samples, 99.9), (unsigned long long)samples.back());
+}
+
+// --------
+
+/// Prints the latency distribution of each operation, as traced and, if available, as replayed.
+static void siloReplayPrintLatencies(void)
+{
+    printf("\nLatency (ns)\n");
+    printf("%-28s %-7s %10s %12s %10s %10s %10s %10s %12s\n", "Operation", "Source", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+
+    for (uint32_t operationType = 1; operationType < siloReplayOperationNameCount; ++operationType)
+    {
+        std::vector<uint64_t> tracedSamples;
+        std::vector<uint64_t> replayedSamples;
+
+        for (size_t i = 0; i < siloReplayOperations.size(); ++i)
+        {
+            const SSiloReplayOperation& operation = siloReplayOperations[i];
+
+            if (operationType != operation.record.operation)
+                continue;
+
+            tracedSamples.push_back(operation.record.duration);
+
+            if (true == operation.wasReplayed)
+                replayedSamples.push_back(operation.replayDuration);
+        }
+
+        siloReplayPrintLatencyRow(siloReplayOperationNames[operationType], "trace", tracedSamples);
+        siloReplayPrintLatencyRow(siloReplayOperationNames[operationType], "replay", replayedSamples);
+    }
+}
+
+// --------
+
+/// Prints the peak number of bytes requested from each NUMA node at any point in the trace.
+/// Local allocations are attributed to the NUMA node on which the calling thread was executing.
+/// @param [in] maxPointerId Largest pointer identifier in the trace.
+static void siloReplayPrintPeakUsage(uint64_t maxPointerId)
+{
+    // Nodes and sizes attributed to each live allocation, so that frees can be subtracted.
+    std::vector<std::vector<std::pair<uint32_t, uint64_t>>> liveAllocations((size_t)maxPointerId + 1);
+    std::map<uint32_t, uint64_t> currentBytes;
+    std::map<uint32_t, uint64_t> peakBytes;
+    uint64_t unattributedBytes = 0;
+
+    for (size_t i = 0; i < siloReplayOperations.size(); ++i)
+    {
+        const SSiloReplayOperation& operation = siloReplayOperations[i];
+        const SSiloTraceRecord& record = operation.record;
+
+        if (0 == record.pointerId)
+            continue;
+
+        std::vector<std::pair<uint32_t, uint64_t>>& attribution = liveAllocations[record.pointerId];
+
+        if (false == siloReplayIsAllocation(record.operation))
+        {
+            for (size_t j = 0; j < attribution.size(); ++j)
+                currentBytes[attribution[j].first] -= attribution[j].second;
+
+            attribution.clear();
+            continue;
+        }
+
+        if (SiloTraceOperationMultinodeArrayAlloc == record.operation)
+        {
+            for (size_t j = 0; j < operation.pieces.size(); ++j)
+                attribution.push_back(std::make_pair(operation.pieces[j].numaNode, (uint64_t)operation.pieces[j].size));
+        }
+        else if (kSiloTraceNoNode != record.numaNode)
+            attribution.push_back(std::make_pair(record.numaNode, record.size));
+        else if (0 <= record.threadNumaNode)
+            attribution.push_back(std::make_pair((uint32_t)record.threadNumaNode, record.size));
+        else
+            unattributedBytes += record.size;
+
+        for (size_t j = 0; j < attribution.size(); ++j)
+        {
+            uint64_t& nodeBytes = currentBytes[attribution[j].first];
+            nodeBytes += attribution[j].second;
+
+            if (peakBytes[attribution[j].first] < nodeBytes)
+                peakBytes[attribution[j].first] = nodeBytes;
+        }
+    }
+
+    printf("\nPeak requested memory\n");
+
+    for (std::map<uint32_t, uint64_t>::const_iterator it = peakBytes.begin(); it != peakBytes.end(); ++it)
+        printf("node %-4u %20llu bytes\n", it->first, (unsigned long long)it->second);
+
+    if (0 != unattributedBytes)
+        printf("unknown   %20llu bytes allocated locally on an unknown node\n", (unsigned long long)unattributedBytes);
+}
+
+// --------
+
+/// Prints the fraction of replayed allocations placed on the expected NUMA node, broken down by operation.
+static void siloReplayPrintPlacement(void)
+{
+    printf("\nPlacement accuracy\n");
+    printf("%-28s %10s %10s %9s\n", "Operation", "Checked", "Correct", "Accuracy");
+
+    for (uint32_t operationType = 1; operationType < siloReplayOperationNameCount; ++operationType)
+    {
+        uint64_t checkedCount = 0;
+        uint64_t correctCount = 0;
+
+        for (size_t i = 0; i < siloReplayOperations.size(); ++i)
+        {
+            if (operationType != siloReplayOperations[i].record.operation)
+                continue;
+
+            checkedCount += siloReplayOperations[i].placementChecked;
+            correctCount += siloReplayOperations[i].placementCorrect;
+        }
+
+        if (0 != checkedCount)
+            printf("%-28s %10llu %10llu %8.2f%%\n", siloReplayOperationNames[operationType], (unsigned long long)checkedCount, (unsigned long long)correctCount, 100.0 * (double)correctCount / (double)checkedCount);
+    }
+}
+
+// --------
+
+/// Prints usage information.
+static void siloReplayPrintUsage(void)
+{
+    fprintf(stderr, "Usage: silo-replay [--free-running] [--no-placement] [--analyze-only] trace-file\n");
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+
+/// Program entry point.
+/// @param [in] argc Number of command-line arguments.
+/// @param [in] argv Command-line arguments.
+/// @return 0 on success, 1 on failure.
+int main(int argc, char* argv[])
+{
+    const char* tracePath = NULL;
+    bool shouldReplay = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], "--free-running"))
+            siloReplayIsFreeRunning = true;
+        else if (0 == strcmp(argv[i], "--no-placement"))
+            siloReplayShouldCheckPlacement = false;
+        else if (0 == strcmp(argv[i], "--analyze-only"))
+            shouldReplay = false;
+        else if (('-' != argv[i][0]) && (NULL == tracePath))
+            tracePath = argv[i];
+        else
+        {
+            siloReplayPrintUsage();
+            return 1;
+        }
+    }
+
+    if (NULL == tracePath)
+    {
+        siloReplayPrintUsage();
+        return 1;
+    }
+
+    const int64_t maxPointerId = siloReplayLoadTrace(tracePath);
+    if (0 > maxPointerId)
+        return 1;
+
+    printf("%s: %llu operations from %llu threads\n", tracePath, (unsigned long long)siloReplayOperations.size(), (unsigned long long)siloReplayThreadOperations.size());
+
+    if (true == shouldReplay)
+    {
+        siloReplayPointers.reset(new SSiloReplayPointer[(size_t)maxPointerId + 1]);
+
+        for (int64_t i = 0; i <= maxPointerId; ++i)
+        {
+            siloReplayPointers[(size_t)i].ptr = NULL;
+            siloReplayPointers[(size_t)i].isReady = false;
+        }
+
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        std::vector<std::thread> replayThreads;
+
+        for (uint32_t i = 0; i < (uint32_t)siloReplayThreadOperations.size(); ++i)
+            replayThreads.push_back(std::thread(siloReplayThreadMain, i));
+
+        for (size_t i = 0; i < replayThreads.size(); ++i)
+            replayThreads[i].join();
+
+        const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        printf("Replayed %s in %.3f seconds\n", (siloReplayIsFreeRunning ? "free-running" : "in recorded order"), elapsedSeconds);
+    }
+
+    siloReplayPrintLatencies();
+    siloReplayPrintPeakUsage((uint64_t)maxPointerId);
+
+    if ((true == shouldReplay) && (true == siloReplayShouldCheckPlacement))
+        siloReplayPrintPlacement();
+
+    return 0;
+}
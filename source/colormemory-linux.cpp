@@ -0,0 +1,511 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file colormemory-linux.cpp
+ *   Implementation of page-colored allocation.
+ *   This file contains Linux-specific functions.
+ *   Physical addresses are read from /proc/self/pagemap, which only reports them to processes with the CAP_SYS_ADMIN capability.
+ *   The number of colors can be overridden by setting the `SILO_COLOR_COUNT` environment variable.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "colormemory.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <numa.h>
+#include <string>
+#include <topo.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <sys/mman.h>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Bit of a pagemap entry that indicates the page is present in physical memory.
+static const uint64_t kSiloColorPagemapPresentBit = 1ull << 63;
+
+/// Bits of a pagemap entry that hold the page frame number.
+static const uint64_t kSiloColorPagemapFrameMask = (1ull << 55) - 1;
+
+/// Maximum number of cache description directories examined per processor.
+static const uint32_t kSiloColorMaximumCacheIndex = 16;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Holds the reserved pages of a single NUMA node that are not currently part of a colored buffer, grouped by color.
+struct SSiloColorNodePool
+{
+    std::vector<void*> freePages[kSiloColorMaximumCount];                   ///< Virtual address of each free page, indexed by color.
+};
+
+/// Describes a colored buffer that has been handed out.
+struct SSiloColorBuffer
+{
+    uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node whose pool supplied the pages.
+    std::vector<uint8_t> pageColors;                                        ///< Color of each page of the buffer, in order.
+};
+
+
+// -------- LOCALS --------------------------------------------------------- //
+
+/// Ensures that availability is determined exactly once.
+static std::once_flag siloColorDetectionFlag;
+
+/// Whether or not coloring is available, and if not, why.
+static ESiloColoringStatus siloColorStatus = SiloColoringStatusUnsupportedPlatform;
+
+/// Number of colors distinguished, or 0 if coloring is unavailable.
+static uint32_t siloColorCount = 0;
+
+/// System page size, which is also the granularity of coloring.
+static size_t siloColorPageSize = 4096;
+
+/// Set once any memory has been reserved, which is a prerequisite for any colored buffer to exist.
+/// Lets siloColorMemoryFree() reject pointers without detecting availability or taking the lock in processes that never use coloring.
+static std::atomic<bool> siloColorHasReservedMemory(false);
+
+/// Guards access to #siloColorNodePools and #siloColorBuffers.
+static std::mutex siloColorLock;
+
+/// Pool of reserved pages for each NUMA node, indexed by zero-based NUMA node index.
+/// Never destroyed, so that colored buffers can still be freed by exit handlers and static destructors that run after those of this library.
+static std::vector<SSiloColorNodePool>& siloColorNodePools = *new std::vector<SSiloColorNodePool>;
+
+/// Maps the base address of each colored buffer that has been handed out to its description. Never destroyed, for the same reason.
+static std::unordered_map<void*, SSiloColorBuffer>& siloColorBuffers = *new std::unordered_map<void*, SSiloColorBuffer>;
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Reads a numeric cache attribute exposed by the kernel, such as a size or associativity.
+/// Sizes may carry a `K`, `M`, or `G` suffix, which is applied.
+/// This is a Linux-specific helper function.
+/// @param [in] cacheDirectory Directory that describes the cache.
+/// @param [in] attributeName Name of the attribute file within the directory.
+/// @return Value of the attribute, or 0 if it could not be read.
+static size_t siloLinuxColorMemoryReadCacheAttribute(const std::string& cacheDirectory, const char* attributeName)
+{
+    FILE* attributeFile = fopen((cacheDirectory + attributeName).c_str(), "r");
+    if (NULL == attributeFile)
+        return 0;
+
+    unsigned long long attributeValue = 0;
+    char attributeSuffix = '\0';
+    const int numParsed = fscanf(attributeFile, "%llu%c", &attributeValue, &attributeSuffix);
+    fclose(attributeFile);
+
+    if (1 > numParsed)
+        return 0;
+
+    switch (attributeSuffix)
+    {
+    case 'G':
+        attributeValue *= 1024;
+        // Fall through.
+    case 'M':
+        attributeValue *= 1024;
+        // Fall through.
+    case 'K':
+        attributeValue *= 1024;
+        break;
+    }
+
+    return (size_t)attributeValue;
+}
+
+// --------
+
+/// Determines the number of page colors in the last-level cache.
+/// Each color is the set of pages whose physical addresses select the same group of cache sets, so the count is the size of one cache way divided by the page size.
+/// The kernel describes only the cache as a whole, so for caches whose sets are spread across slices by a hash of the address, this overstates the count by the number of slices.
+/// The `SILO_COLOR_COUNT` environment variable, if set, replaces the detected count, which lets the per-slice count be supplied on such systems.
+/// This is a Linux-specific helper function.
+/// @return Number of colors, rounded down to a power of two and capped at #kSiloColorMaximumCount, or 0 if the cache cannot be described.
+static uint32_t siloLinuxColorMemoryDetectColorCount(void)
+{
+    const char* colorCountString = getenv("SILO_COLOR_COUNT");
+    size_t lastLevel = 0;
+    size_t bytesPerWay = 0;
+
+    if ((NULL != colorCountString) && ('\0' == colorCountString[0]))
+        colorCountString = NULL;
+
+    if (NULL != colorCountString)
+        bytesPerWay = (size_t)strtoull(colorCountString, NULL, 0) * siloColorPageSize;
+
+    for (uint32_t i = 0; (NULL == colorCountString) && (i < kSiloColorMaximumCacheIndex); ++i)
+    {
+        const std::string cacheDirectory = std::string("/sys/devices/system/cpu/cpu0/cache/index") + std::to_string(i) + "/";
+        const size_t cacheLevel = siloLinuxColorMemoryReadCacheAttribute(cacheDirectory, "level");
+
+        if (0 == cacheLevel)
+            break;
+
+        const size_t cacheSize = siloLinuxColorMemoryReadCacheAttribute(cacheDirectory, "size");
+        const size_t cacheWays = siloLinuxColorMemoryReadCacheAttribute(cacheDirectory, "ways_of_associativity");
+
+        if ((cacheLevel > lastLevel) && (0 != cacheSize) && (0 != cacheWays))
+        {
+            lastLevel = cacheLevel;
+            bytesPerWay = cacheSize / cacheWays;
+        }
+    }
+
+    uint32_t colorCount = 1;
+
+    while (((size_t)colorCount * 2 * siloColorPageSize <= bytesPerWay) && (colorCount < kSiloColorMaximumCount))
+        colorCount *= 2;
+
+    return ((1 < colorCount) ? colorCount : 0);
+}
+
+// --------
+
+/// Reads the physical page frame number of each page in a range of the calling process's address space.
+/// This is a Linux-specific helper function.
+/// @param [in] base Page-aligned start address of the range.
+/// @param [in] pageCount Number of pages in the range.
+/// @param [out] frameNumbers Filled with the frame number of each page, or 0 for pages that are not present or whose frame number is hidden.
+/// @return `true` if the information was read, `false` otherwise.
+static bool siloLinuxColorMemoryReadFrameNumbers(void* base, size_t pageCount, std::vector<uint64_t>* frameNumbers)
+{
+    const int pagemapFile = open("/proc/self/pagemap", O_RDONLY);
+    if (0 > pagemapFile)
+        return false;
+
+    frameNumbers->resize(pageCount);
+
+    const size_t bytesToRead = pageCount * sizeof(uint64_t);
+    const ssize_t bytesRead = pread(pagemapFile, &(*frameNumbers)[0], bytesToRead, (off_t)(((size_t)base / siloColorPageSize) * sizeof(uint64_t)));
+    close(pagemapFile);
+
+    if (bytesRead != (ssize_t)bytesToRead)
+        return false;
+
+    for (size_t i = 0; i < pageCount; ++i)
+    {
+        const uint64_t pagemapEntry = (*frameNumbers)[i];
+        (*frameNumbers)[i] = ((0 != (pagemapEntry & kSiloColorPagemapPresentBit)) ? (pagemapEntry & kSiloColorPagemapFrameMask) : 0);
+    }
+
+    return true;
+}
+
+// --------
+
+/// Determines whether coloring is available and initializes the pools if so.
+/// This is a Linux-specific helper function.
+static void siloLinuxColorMemoryDetect(void)
+{
+    siloColorPageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    const uint32_t colorCount = siloLinuxColorMemoryDetectColorCount();
+    if (0 == colorCount)
+    {
+        siloColorStatus = SiloColoringStatusNoCacheInformation;
+        return;
+    }
+
+    // Fault in a single page and check whether its frame number is visible.
+    // Without sufficient privilege the kernel reports every frame number as zero.
+    void* probePage = mmap(NULL, siloColorPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == probePage)
+    {
+        siloColorStatus = SiloColoringStatusNoPhysicalAddressAccess;
+        return;
+    }
+
+    *((volatile uint8_t*)probePage) = 1;
+
+    std::vector<uint64_t> probeFrameNumber;
+    const bool frameNumberIsVisible = (siloLinuxColorMemoryReadFrameNumbers(probePage, 1, &probeFrameNumber) && (0 != probeFrameNumber[0]));
+    munmap(probePage, siloColorPageSize);
+
+    if (false == frameNumberIsVisible)
+    {
+        siloColorStatus = SiloColoringStatusNoPhysicalAddressAccess;
+        return;
+    }
+
+    siloColorNodePools.resize(topoGetSystemNUMANodeCount());
+    siloColorCount = colorCount;
+    siloColorStatus = SiloColoringStatusAvailable;
+}
+
+// --------
+
+/// Ensures that availability has been determined.
+/// This is a Linux-specific helper function.
+/// @return `true` if coloring is available, `false` otherwise.
+static bool siloLinuxColorMemoryIsAvailable(void)
+{
+    std::call_once(siloColorDetectionFlag, siloLinuxColorMemoryDetect);
+    return (SiloColoringStatusAvailable == siloColorStatus);
+}
+
+// --------
+
+/// Restricts a color mask to the colors that are actually distinguished.
+/// This is a Linux-specific helper function.
+/// @param [in] colorMask Bit mask of colors supplied by the caller.
+/// @return Bit mask with all bits beyond the number of colors cleared.
+static uint64_t siloLinuxColorMemoryGetValidColorMask(uint64_t colorMask)
+{
+    if (kSiloColorMaximumCount <= siloColorCount)
+        return colorMask;
+
+    return colorMask & ((1ull << siloColorCount) - 1);
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "colormemory.h" for documentation.
+
+ESiloColoringStatus siloColorMemoryGetStatus(void)
+{
+    siloLinuxColorMemoryIsAvailable();
+    return siloColorStatus;
+}
+
+// --------
+
+uint32_t siloColorMemoryGetColorCount(void)
+{
+    siloLinuxColorMemoryIsAvailable();
+    return siloColorCount;
+}
+
+// --------
+
+ESiloColorReserveResult siloColorMemoryReserve(size_t size, uint32_t numaNode)
+{
+    if ((false == siloLinuxColorMemoryIsAvailable()) || (numaNode >= siloColorNodePools.size()))
+        return SiloColorReserveResultFailure;
+
+    const int32_t numaNodeOSIndex = topoGetNUMANodeOSIndex(numaNode);
+    const size_t pageCount = (size + siloColorPageSize - 1) / siloColorPageSize;
+
+    if ((0 > numaNodeOSIndex) || (0 == pageCount))
+        return SiloColorReserveResultFailure;
+
+    uint8_t* reservation = (uint8_t*)mmap(NULL, pageCount * siloColorPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == (void*)reservation)
+        return SiloColorReserveResultFailure;
+
+    // Large pages would make every small page within them the same color, so they must not be used.
+    // Bind the reservation to the node, then fault in and lock every page so that its frame, and therefore its color, stays fixed.
+    madvise(reservation, pageCount * siloColorPageSize, MADV_NOHUGEPAGE);
+    numa_tonode_memory(reservation, pageCount * siloColorPageSize, numaNodeOSIndex);
+
+    for (size_t i = 0; i < pageCount; ++i)
+        *((volatile uint8_t*)(reservation + (i * siloColorPageSize))) = 0;
+
+    // Without the lock, the kernel is free to migrate or compact the pages onto frames of other colors.
+    if (0 != mlock(reservation, pageCount * siloColorPageSize))
+    {
+        munmap(reservation, pageCount * siloColorPageSize);
+        return SiloColorReserveResultCannotLock;
+    }
+
+    std::vector<uint64_t> frameNumbers;
+    if (false == siloLinuxColorMemoryReadFrameNumbers(reservation, pageCount, &frameNumbers))
+    {
+        munmap(reservation, pageCount * siloColorPageSize);
+        return SiloColorReserveResultFailure;
+    }
+
+    // Sort the pages by color.
+    std::lock_guard<std::mutex> siloColorLocalGuard(siloColorLock);
+    SSiloColorNodePool& nodePool = siloColorNodePools[numaNode];
+
+    for (size_t i = 0; i < pageCount; ++i)
+    {
+        // A page whose frame is unknown cannot be colored, so it is simply left unused.
+        if (0 != frameNumbers[i])
+            nodePool.freePages[frameNumbers[i] & (siloColorCount - 1)].push_back(reservation + (i * siloColorPageSize));
+    }
+
+    siloColorHasReservedMemory.store(true, std::memory_order_release);
+    return SiloColorReserveResultSuccess;
+}
+
+// --------
+
+size_t siloColorMemoryGetFreeSize(uint32_t numaNode, uint64_t colorMask)
+{
+    if ((false == siloLinuxColorMemoryIsAvailable()) || (numaNode >= siloColorNodePools.size()))
+        return 0;
+
+    colorMask = siloLinuxColorMemoryGetValidColorMask(colorMask);
+
+    std::lock_guard<std::mutex> siloColorLocalGuard(siloColorLock);
+    const SSiloColorNodePool& nodePool = siloColorNodePools[numaNode];
+    size_t freePageCount = 0;
+
+    for (uint32_t i = 0; i < siloColorCount; ++i)
+    {
+        if (0 != (colorMask & (1ull << i)))
+            freePageCount += nodePool.freePages[i].size();
+    }
+
+    return freePageCount * siloColorPageSize;
+}
+
+// --------
+
+void* siloColorMemoryAlloc(size_t size, uint32_t numaNode, uint64_t colorMask)
+{
+    if ((false == siloLinuxColorMemoryIsAvailable()) || (numaNode >= siloColorNodePools.size()))
+        return NULL;
+
+    colorMask = siloLinuxColorMemoryGetValidColorMask(colorMask);
+
+    const size_t pageCount = (size + siloColorPageSize - 1) / siloColorPageSize;
+    if ((0 == pageCount) || (0 == colorMask))
+        return NULL;
+
+    // Take the pages out of the pool, rotating through the requested colors.
+    std::vector<void*> sourcePages(pageCount);
+    SSiloColorBuffer colorBuffer;
+    colorBuffer.numaNode = numaNode;
+    colorBuffer.pageColors.resize(pageCount);
+
+    {
+        std::lock_guard<std::mutex> siloColorLocalGuard(siloColorLock);
+        SSiloColorNodePool& nodePool = siloColorNodePools[numaNode];
+        size_t freePageCount = 0;
+
+        for (uint32_t i = 0; i < siloColorCount; ++i)
+        {
+            if (0 != (colorMask & (1ull << i)))
+                freePageCount += nodePool.freePages[i].size();
+        }
+
+        if (freePageCount < pageCount)
+            return NULL;
+
+        uint32_t currentColor = 0;
+
+        for (size_t i = 0; i < pageCount; ++i)
+        {
+            while ((0 == (colorMask & (1ull << currentColor))) || (true == nodePool.freePages[currentColor].empty()))
+                currentColor = (currentColor + 1) % siloColorCount;
+
+            sourcePages[i] = nodePool.freePages[currentColor].back();
+            nodePool.freePages[currentColor].pop_back();
+            colorBuffer.pageColors[i] = (uint8_t)currentColor;
+            currentColor = (currentColor + 1) % siloColorCount;
+        }
+
+        // Every run of pages that are not already adjacent will occupy its own mapping once moved, so refuse buffers that would use too many.
+        size_t mappingCount = 1;
+
+        for (size_t i = 1; i < pageCount; ++i)
+        {
+            if ((uint8_t*)sourcePages[i] != ((uint8_t*)sourcePages[i - 1] + siloColorPageSize))
+                mappingCount += 1;
+        }
+
+        if (mappingCount > kSiloColorMaximumMappingsPerBuffer)
+        {
+            for (size_t i = 0; i < pageCount; ++i)
+                nodePool.freePages[colorBuffer.pageColors[i]].push_back(sourcePages[i]);
+
+            return NULL;
+        }
+    }
+
+    // Reserve a virtually-contiguous range and move each run of adjacent pages into place with a single call.
+    // Moving a page changes only its virtual address, so it keeps its physical frame and color.
+    uint8_t* allocatedBuffer = (uint8_t*)mmap(NULL, pageCount * siloColorPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    size_t numMoved = 0;
+
+    if (MAP_FAILED == (void*)allocatedBuffer)
+        allocatedBuffer = NULL;
+    else
+    {
+        bool shouldMoveSinglePage = false;
+
+        while (numMoved < pageCount)
+        {
+            size_t runLength = 1;
+
+            while ((false == shouldMoveSinglePage) && ((numMoved + runLength) < pageCount) && ((uint8_t*)sourcePages[numMoved + runLength] == ((uint8_t*)sourcePages[numMoved] + (runLength * siloColorPageSize))))
+                runLength += 1;
+
+            if (MAP_FAILED == mremap(sourcePages[numMoved], runLength * siloColorPageSize, runLength * siloColorPageSize, MREMAP_MAYMOVE | MREMAP_FIXED, allocatedBuffer + (numMoved * siloColorPageSize)))
+            {
+                // Adjacent pages can still belong to different mappings, which cannot be moved together, so retry the first page on its own.
+                if (1 == runLength)
+                    break;
+
+                shouldMoveSinglePage = true;
+                continue;
+            }
+
+            for (size_t i = 0; i < runLength; ++i)
+                sourcePages[numMoved + i] = allocatedBuffer + ((numMoved + i) * siloColorPageSize);
+
+            numMoved += runLength;
+            shouldMoveSinglePage = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> siloColorLocalGuard(siloColorLock);
+
+    if ((NULL == allocatedBuffer) || (numMoved < pageCount))
+    {
+        // Return every page to the pool, wherever it currently resides, and release the part of the range that was never filled.
+        SSiloColorNodePool& nodePool = siloColorNodePools[numaNode];
+
+        for (size_t i = 0; i < pageCount; ++i)
+            nodePool.freePages[colorBuffer.pageColors[i]].push_back(sourcePages[i]);
+
+        if (NULL != allocatedBuffer)
+            munmap(allocatedBuffer + (numMoved * siloColorPageSize), (pageCount - numMoved) * siloColorPageSize);
+
+        return NULL;
+    }
+
+    siloColorBuffers.insert({(void*)allocatedBuffer, colorBuffer});
+    return allocatedBuffer;
+}
+
+// --------
+
+bool siloColorMemoryFree(void* ptr)
+{
+    if (false == siloColorHasReservedMemory.load(std::memory_order_acquire))
+        return false;
+
+    std::lock_guard<std::mutex> siloColorLocalGuard(siloColorLock);
+
+    std::unordered_map<void*, SSiloColorBuffer>::iterator colorBufferIterator = siloColorBuffers.find(ptr);
+    if (siloColorBuffers.end() == colorBufferIterator)
+        return false;
+
+    // The pages stay mapped and locked where they are, ready to be moved into another buffer.
+    const SSiloColorBuffer& colorBuffer = colorBufferIterator->second;
+    SSiloColorNodePool& nodePool = siloColorNodePools[colorBuffer.numaNode];
+
+    for (size_t i = 0; i < colorBuffer.pageColors.size(); ++i)
+        nodePool.freePages[colorBuffer.pageColors[i]].push_back((uint8_t*)ptr + (i * siloColorPageSize));
+
+    siloColorBuffers.erase(colorBufferIterator);
+    return true;
+}
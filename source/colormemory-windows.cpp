@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file colormemory-windows.cpp
+ *   Implementation of page-colored allocation.
+ *   This file contains Windows-specific functions.
+ *   Windows does not expose the physical addresses of pages to applications, so coloring is never available.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "colormemory.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "colormemory.h" for documentation.
+
+ESiloColoringStatus siloColorMemoryGetStatus(void)
+{
+    return SiloColoringStatusUnsupportedPlatform;
+}
+
+// --------
+
+uint32_t siloColorMemoryGetColorCount(void)
+{
+    return 0;
+}
+
+// --------
+
+ESiloColorReserveResult siloColorMemoryReserve(size_t size, uint32_t numaNode)
+{
+    return SiloColorReserveResultFailure;
+}
+
+// --------
+
+size_t siloColorMemoryGetFreeSize(uint32_t numaNode, uint64_t colorMask)
+{
+    return 0;
+}
+
+// --------
+
+void* siloColorMemoryAlloc(size_t size, uint32_t numaNode, uint64_t colorMask)
+{
+    return NULL;
+}
+
+// --------
+
+bool siloColorMemoryFree(void* ptr)
+{
+    return false;
+}
@@ -17,8 +17,12 @@
 #include "osmemory.h"
 #include "pointermap.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fcntl.h>
 #include <numa.h>
 #include <numaif.h>
 #include <sched.h>
@@ -28,6 +32,254 @@
 #include <sys/mman.h>
 
 
+// -------- CONSTANTS ------------------------------------------------------ //
+
+#ifndef MADV_COLLAPSE
+/// Advice value for synchronous large-page collapse, added in Linux 6.1.
+/// Defined here so that Silo can be built against older system headers.
+#define MADV_COLLAPSE                           25
+#endif
+
+#ifndef MADV_FREE
+/// Advice value for lazily freeing pages, added in Linux 4.5.
+#define MADV_FREE                               8
+#endif
+
+#ifndef MADV_COLD
+/// Advice value for deprioritizing pages for reclaim, added in Linux 5.4.
+#define MADV_COLD                               20
+#endif
+
+#ifndef MADV_PAGEOUT
+/// Advice value for reclaiming pages immediately, added in Linux 5.4.
+#define MADV_PAGEOUT                            21
+#endif
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Computes the number of bytes actually mapped to satisfy an allocation of the specified size.
+/// Buffers that use large-page support are mapped in whole large pages so that their tails are eligible for large-page backing.
+/// This is a Linux-specific helper function.
+/// @param [in] size Number of bytes requested.
+/// @return Number of bytes that are mapped for the allocation.
+static size_t siloLinuxMemoryGetMappedSize(size_t size)
+{
+    const size_t allocationUnitSize = siloOSMemoryGetGranularity(siloOSMemoryShouldAutoEnableLargePageSupport(size));
+    return ((size + allocationUnitSize - 1) / allocationUnitSize) * allocationUnitSize;
+}
+
+// --------
+
+/// Maps anonymous memory whose base address is aligned to the specified boundary.
+/// Over-reserves virtual address space and then trims the unaligned head and tail, unless the alignment is just the page size.
+/// This is a Linux-specific helper function.
+/// @param [in] size Number of bytes to map, which should be a non-zero multiple of the page size.
+/// @param [in] alignment Required alignment of the base address, which must be a multiple of the page size.
+/// @return Pointer to the start of the mapped region, or NULL on failure.
+static void* siloLinuxMemoryMapAligned(size_t size, size_t alignment)
+{
+    if (0 == size)
+        return NULL;
+    
+    // Every mapping is page-aligned already.
+    if (alignment <= siloOSMemoryGetGranularity(false))
+    {
+        void* result = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (MAP_FAILED == result ? NULL : result);
+    }
+    
+    void* reservation = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == reservation)
+        return NULL;
+    
+    const size_t reservationBase = (size_t)reservation;
+    const size_t reservationEnd = reservationBase + size + alignment;
+    const size_t alignedBase = ((reservationBase + alignment - 1) / alignment) * alignment;
+    const size_t headBytes = alignedBase - reservationBase;
+    const size_t tailBytes = reservationEnd - (alignedBase + size);
+    
+    if (0 != headBytes)
+        munmap(reservation, headBytes);
+    
+    if (0 != tailBytes)
+        munmap((void*)(alignedBase + size), tailBytes);
+    
+    return (void*)alignedBase;
+}
+
+
+// --------
+
+/// Determines exactly how many bytes of a memory region are backed by large pages by examining the physical page behind each virtual page.
+/// Requires access to physical page frame numbers in `/proc/self/pagemap` and to `/proc/kpageflags`, both of which are normally restricted to privileged processes.
+/// This is a Linux-specific helper function.
+/// @param [in] ptr Page-aligned pointer to the start of the memory region.
+/// @param [in] size Number of bytes in the memory region, a multiple of the page size.
+/// @param [out] backedBytes Filled with the number of bytes backed by large pages.
+/// @return `true` if the exact value was determined, `false` if the required information is unavailable.
+static bool siloLinuxMemoryGetExactLargePageBackedSize(void* ptr, size_t size, size_t* backedBytes)
+{
+    static const uint64_t kPagemapPresentBit = 1ull << 63;
+    static const uint64_t kPagemapFrameMask = (1ull << 55) - 1;
+    static const uint64_t kPageFlagsLargePageBits = (1ull << 17) | (1ull << 22);  // KPF_HUGE and KPF_THP
+    static const size_t kPagesPerRead = 512;
+    
+    const size_t pageSize = siloOSMemoryGetGranularity(false);
+    const size_t pageCount = size / pageSize;
+    
+    const int pagemapFile = open("/proc/self/pagemap", O_RDONLY);
+    if (0 > pagemapFile)
+        return false;
+    
+    const int pageFlagsFile = open("/proc/kpageflags", O_RDONLY);
+    if (0 > pageFlagsFile)
+    {
+        close(pagemapFile);
+        return false;
+    }
+    
+    uint64_t pagemapEntries[kPagesPerRead];
+    uint64_t pageFlags[kPagesPerRead];
+    bool isSuccessful = true;
+    
+    *backedBytes = 0;
+    
+    for (size_t chunkStart = 0; (true == isSuccessful) && (chunkStart < pageCount); chunkStart += kPagesPerRead)
+    {
+        const size_t chunkPages = ((pageCount - chunkStart) < kPagesPerRead ? (pageCount - chunkStart) : kPagesPerRead);
+        const off_t pagemapOffset = (off_t)((((size_t)ptr / pageSize) + chunkStart) * sizeof(uint64_t));
+        
+        if ((ssize_t)(chunkPages * sizeof(uint64_t)) != pread(pagemapFile, pagemapEntries, chunkPages * sizeof(uint64_t), pagemapOffset))
+        {
+            isSuccessful = false;
+            break;
+        }
+        
+        // Pages backed by the same large page have consecutive frame numbers, so read the flags for each run of consecutive frames at once.
+        size_t i = 0;
+        while (i < chunkPages)
+        {
+            const uint64_t runFirstFrame = pagemapEntries[i] & kPagemapFrameMask;
+            
+            if (0 == (pagemapEntries[i] & kPagemapPresentBit))
+            {
+                ++i;
+                continue;
+            }
+            
+            // Without sufficient privilege the kernel reports the frame number of every present page as zero.
+            if (0 == runFirstFrame)
+            {
+                isSuccessful = false;
+                break;
+            }
+            
+            size_t runLength = 1;
+            while (((i + runLength) < chunkPages) && (0 != (pagemapEntries[i + runLength] & kPagemapPresentBit)) && ((runFirstFrame + runLength) == (pagemapEntries[i + runLength] & kPagemapFrameMask)))
+                ++runLength;
+            
+            if ((ssize_t)(runLength * sizeof(uint64_t)) != pread(pageFlagsFile, pageFlags, runLength * sizeof(uint64_t), (off_t)(runFirstFrame * sizeof(uint64_t))))
+            {
+                isSuccessful = false;
+                break;
+            }
+            
+            for (size_t j = 0; j < runLength; ++j)
+            {
+                if (0 != (pageFlags[j] & kPageFlagsLargePageBits))
+                    *backedBytes += pageSize;
+            }
+            
+            i += runLength;
+        }
+    }
+    
+    close(pageFlagsFile);
+    close(pagemapFile);
+    
+    return isSuccessful;
+}
+
+// --------
+
+/// Determines an upper bound on the number of bytes of a memory region that are backed by large pages, using the statistics in `/proc/self/smaps`.
+/// Large-page statistics are reported per virtual memory area, which may include neighbouring buffers, so they are only capped at the number of bytes that overlap the region.
+/// This is a Linux-specific helper function.
+/// @param [in] ptr Pointer to the start of the memory region.
+/// @param [in] size Number of bytes in the memory region.
+/// @return Upper bound on the number of bytes backed by large pages, which is 0 if the information is unavailable.
+static size_t siloLinuxMemoryGetUpperBoundLargePageBackedSize(void* ptr, size_t size)
+{
+    FILE* smapsFile = fopen("/proc/self/smaps", "r");
+    if (NULL == smapsFile)
+        return 0;
+    
+    const size_t rangeStart = (size_t)ptr;
+    const size_t rangeEnd = rangeStart + size;
+    
+    size_t backedBytes = 0;
+    size_t overlapBytes = 0;
+    char line[512];
+    
+    // Each mapping begins with an address range line, followed by per-mapping statistics.
+    while (NULL != fgets(line, sizeof(line), smapsFile))
+    {
+        unsigned long long mappingStart = 0, mappingEnd = 0, statisticKilobytes = 0;
+        
+        if (2 == sscanf(line, "%llx-%llx ", &mappingStart, &mappingEnd))
+        {
+            const size_t overlapStart = ((size_t)mappingStart > rangeStart ? (size_t)mappingStart : rangeStart);
+            const size_t overlapEnd = ((size_t)mappingEnd < rangeEnd ? (size_t)mappingEnd : rangeEnd);
+            overlapBytes = (overlapEnd > overlapStart ? overlapEnd - overlapStart : 0);
+        }
+        else if ((0 != overlapBytes) && ((1 == sscanf(line, "AnonHugePages: %llu kB", &statisticKilobytes)) || (1 == sscanf(line, "ShmemPmdMapped: %llu kB", &statisticKilobytes))))
+        {
+            const size_t statisticBytes = (size_t)statisticKilobytes * 1024;
+            backedBytes += (statisticBytes < overlapBytes ? statisticBytes : overlapBytes);
+        }
+    }
+    
+    fclose(smapsFile);
+    return backedBytes;
+}
+
+// --------
+
+/// Determines the advice value to pass to `madvise` for a hint.
+/// This is a Linux-specific helper function.
+/// @param [in] hint Hint to translate.
+/// @return Advice value, or negative if the hint is not expressed as advice.
+static int siloLinuxMemoryGetAdvice(ESiloMemoryHint hint)
+{
+    switch (hint)
+    {
+    case SiloMemoryHintNormal:
+        return MADV_NORMAL;
+    case SiloMemoryHintSequential:
+        return MADV_SEQUENTIAL;
+    case SiloMemoryHintRandom:
+        return MADV_RANDOM;
+    case SiloMemoryHintWillNeed:
+        return MADV_WILLNEED;
+    case SiloMemoryHintCold:
+        return MADV_COLD;
+    case SiloMemoryHintPageOut:
+        return MADV_PAGEOUT;
+    case SiloMemoryHintDontDump:
+        return MADV_DONTDUMP;
+    case SiloMemoryHintDump:
+        return MADV_DODUMP;
+    case SiloMemoryHintLargePages:
+        return MADV_HUGEPAGE;
+    case SiloMemoryHintNoLargePages:
+        return MADV_NOHUGEPAGE;
+    default:
+        return -1;
+    }
+}
+
+
 // -------- FUNCTIONS ------------------------------------------------------ //
 // See "osmemory.h" for documentation.
 
@@ -64,70 +316,255 @@ int32_t siloOSMemoryGetNUMANodeForVirtualAddress(void* address)
 
 // --------
 
+int32_t siloOSMemoryGetCurrentNUMANode(void)
+{
+    const int currentProcessor = sched_getcpu();
+    if (0 > currentProcessor)
+        return -1;
+    
+    return (int32_t)numa_node_of_cpu(currentProcessor);
+}
+
+// --------
+
+size_t siloOSMemoryGetNUMANodeFreeSize(uint32_t numaNode)
+{
+    long long freeBytes = 0;
+    
+    if (0 > numa_node_size64((int)numaNode, &freeBytes))
+        return 0;
+    
+    return (size_t)freeBytes;
+}
+
+// --------
+
+uint32_t siloOSMemoryGetNUMANodeProcessorCount(uint32_t numaNode)
+{
+    struct bitmask* processorMask = numa_allocate_cpumask();
+    uint32_t processorCount = 0;
+    
+    if (0 == numa_node_to_cpus((int)numaNode, processorMask))
+        processorCount = (uint32_t)numa_bitmask_weight(processorMask);
+    
+    numa_free_cpumask(processorMask);
+    return processorCount;
+}
+
+// --------
+
 void* siloOSMemoryAllocNUMA(size_t size, uint32_t numaNode)
 {
-    void* result = numa_alloc_onnode(size, (int)numaNode);
+    const bool useLargePageSupport = siloOSMemoryShouldAutoEnableLargePageSupport(size);
+    const size_t mappedSize = siloLinuxMemoryGetMappedSize(size);
     
-    if ((NULL != result) && (siloOSMemoryShouldAutoEnableLargePageSupport(size)))
-        madvise(result, size, MADV_HUGEPAGE);
+    // Large-page buffers are aligned to the large-page size so that the head and tail are not left on small pages.
+    void* result = siloLinuxMemoryMapAligned(mappedSize, siloOSMemoryGetGranularity(useLargePageSupport));
+    if (NULL == result)
+        return NULL;
+    
+    // Bind the buffer to the requested node before any of it is faulted in.
+    numa_tonode_memory(result, mappedSize, (int)numaNode);
+    
+    if (true == useLargePageSupport)
+        madvise(result, mappedSize, MADV_HUGEPAGE);
     
     return result;
 }
 
 // --------
 
+bool siloOSMemoryAllocNUMABatch(uint32_t count, const size_t* sizes, uint32_t numaNode, void** ptrs)
+{
+    if (0 == count)
+        return true;
+    
+    // Lay out all of the buffers in a single mapping, large-page buffers first.
+    // Each large-page buffer occupies a whole number of large pages, so every one of them starts on a large-page boundary provided the mapping itself does.
+    size_t largePageBytes = 0;
+    size_t totalBytes = 0;
+    
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (0 == sizes[i])
+            return false;
+        
+        if (true == siloOSMemoryShouldAutoEnableLargePageSupport(sizes[i]))
+            largePageBytes += siloLinuxMemoryGetMappedSize(sizes[i]);
+        else
+            totalBytes += siloLinuxMemoryGetMappedSize(sizes[i]);
+    }
+    
+    totalBytes += largePageBytes;
+    
+    uint8_t* const mappingBase = (uint8_t*)siloLinuxMemoryMapAligned(totalBytes, siloOSMemoryGetGranularity(0 != largePageBytes));
+    if (NULL == mappingBase)
+        return false;
+    
+    // Bind the whole mapping at once, before any of it is faulted in.
+    numa_tonode_memory(mappingBase, totalBytes, (int)numaNode);
+    
+    if (0 != largePageBytes)
+        madvise(mappingBase, largePageBytes, MADV_HUGEPAGE);
+    
+    // Hand out the buffers.
+    size_t largePageOffset = 0;
+    size_t smallPageOffset = largePageBytes;
+    
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        size_t& offset = (siloOSMemoryShouldAutoEnableLargePageSupport(sizes[i]) ? largePageOffset : smallPageOffset);
+        
+        ptrs[i] = mappingBase + offset;
+        offset += siloLinuxMemoryGetMappedSize(sizes[i]);
+    }
+    
+    return true;
+}
+
+// --------
+
 void* siloOSMemoryAllocLocalNUMA(size_t size)
 {
-    return siloOSMemoryAllocNUMA(size, numa_node_of_cpu(sched_getcpu()));
+    const int32_t numaNode = siloOSMemoryGetCurrentNUMANode();
+    if (0 > numaNode)
+        return NULL;
+    
+    return siloOSMemoryAllocNUMA(size, (uint32_t)numaNode);
 }
 
 // --------
 
 void siloOSMemoryFreeNUMA(void* ptr, size_t size)
 {
-    numa_free(ptr, size);
+    munmap(ptr, siloLinuxMemoryGetMappedSize(size));
 }
 
 // --------
 
-void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
+void siloOSMemoryFreeNUMABatch(uint32_t count, const SSiloAllocationSpec* specs)
 {
-    // Figure out if large page support is worth it.
-    size_t totalRequestedBytes = 0;
+    // Determine the address range occupied by each buffer and sort them by address.
+    std::vector<std::pair<size_t, size_t>> mappedRanges(count);
     
     for (uint32_t i = 0; i < count; ++i)
-        totalRequestedBytes += spec[i].size;
+    {
+        mappedRanges[i].first = (size_t)specs[i].ptr;
+        mappedRanges[i].second = (size_t)specs[i].ptr + siloLinuxMemoryGetMappedSize(specs[i].size);
+    }
+    
+    std::sort(mappedRanges.begin(), mappedRanges.end());
+    
+    // Unmap each run of adjacent buffers with a single call.
+    size_t i = 0;
+    while (i < mappedRanges.size())
+    {
+        const size_t runStart = mappedRanges[i].first;
+        size_t runEnd = mappedRanges[i].second;
+        
+        for (++i; (i < mappedRanges.size()) && (runEnd == mappedRanges[i].first); ++i)
+            runEnd = mappedRanges[i].second;
+        
+        munmap((void*)runStart, runEnd - runStart);
+    }
+}
+
+// --------
+
+bool siloOSMemoryCollapseLargePages(void* ptr, size_t size)
+{
+    return (0 == madvise(ptr, siloLinuxMemoryGetMappedSize(size), MADV_COLLAPSE));
+}
+
+// --------
+
+size_t siloOSMemoryGetLargePageBackedSize(void* ptr, size_t size)
+{
+    const size_t rangeSize = siloLinuxMemoryGetMappedSize(size);
+    size_t backedBytes = 0;
     
-    const bool useLargePageSupport = siloOSMemoryShouldAutoEnableLargePageSupport(totalRequestedBytes);
+    if (true == siloLinuxMemoryGetExactLargePageBackedSize(ptr, rangeSize, &backedBytes))
+        return backedBytes;
     
-    // Get the minimum allocation unit size.
-    const size_t allocationUnitSize = siloOSMemoryGetGranularity(useLargePageSupport);
+    return siloLinuxMemoryGetUpperBoundLargePageBackedSize(ptr, rangeSize);
+}
+
+// --------
+
+bool siloOSMemoryApplyHint(void* ptr, size_t size, ESiloMemoryHint hint)
+{
+    const size_t pageSize = siloOSMemoryGetGranularity(false);
+    const size_t regionStart = ((size_t)ptr / pageSize) * pageSize;
+    const size_t regionEnd = (((size_t)ptr + size + pageSize - 1) / pageSize) * pageSize;
     
-    // Compute the total number of bytes requested and granted, and simultaneously verify the passed NUMA node indices.
-    size_t totalActualBytes = 0;
-    std::vector<size_t> actualBytes(count);
+    if (regionEnd <= regionStart)
+        return false;
     
-    for (uint32_t i = 0; i < count; ++i)
+    switch (hint)
     {
-        if (0 > topoGetNUMANodeOSIndex(spec[i].numaNode))
-            return NULL;
+    case SiloMemoryHintLock:
+        return (0 == mlock((void*)regionStart, regionEnd - regionStart));
+        
+    case SiloMemoryHintUnlock:
+        return (0 == munlock((void*)regionStart, regionEnd - regionStart));
         
-        actualBytes[i] = siloOSMemoryRoundAllocationSize(spec[i].size, useLargePageSupport);
-        totalActualBytes += actualBytes[i];
+    default:
+        {
+            const int advice = siloLinuxMemoryGetAdvice(hint);
+            return ((0 <= advice) && (0 == madvise((void*)regionStart, regionEnd - regionStart, advice)));
+        }
     }
+}
+
+// --------
+
+bool siloOSMemoryRelease(void* ptr, size_t size, ESiloReleaseMode mode)
+{
+    const size_t pageSize = siloOSMemoryGetGranularity(false);
+    const size_t regionStart = (((size_t)ptr + pageSize - 1) / pageSize) * pageSize;
+    const size_t regionEnd = (((size_t)ptr + size) / pageSize) * pageSize;
     
-    // Verify that sufficient space was actually allocated on each node to justify even using this function.
-    if (0 == totalActualBytes)
-        return NULL;
+    // Nothing to do if the region does not cover a whole page.
+    if (regionEnd <= regionStart)
+        return true;
     
-    // Add sufficient additional space to allocate to the last NUMA node to ensure coverage of the total requested size.
-    while (totalActualBytes < totalRequestedBytes)
+    // The virtual memory area keeps its memory policy, so pages faulted in later are placed on the same NUMA node as before.
+    if (SiloReleaseModeLazy == mode)
     {
-        totalActualBytes += allocationUnitSize;
-        actualBytes[count - 1] += allocationUnitSize;
+        if (0 == madvise((void*)regionStart, regionEnd - regionStart, MADV_FREE))
+            return true;
+        
+        // Shared mappings and kernels that predate lazy freeing reject it, in which case the memory is released immediately instead.
+        if (EINVAL != errno)
+            return false;
     }
     
+    // Discarding a shared mapping's pages from this process alone frees nothing, because the shared object still holds them.
+    // Instead, the pages are removed from the object itself, after which every process that maps it sees the range as zero-filled.
+    // Private mappings reject this, and are released by discarding their pages instead.
+    if (0 == madvise((void*)regionStart, regionEnd - regionStart, MADV_REMOVE))
+        return true;
+    
+    if (EINVAL != errno)
+        return false;
+    
+    return (0 == madvise((void*)regionStart, regionEnd - regionStart, MADV_DONTNEED));
+}
+
+// --------
+
+void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
+{
+    // Determine the size of each piece.
+    std::vector<size_t> actualBytes;
+    bool useLargePageSupport = false;
+    
+    const size_t totalActualBytes = siloOSMemoryComputeMultiNUMAPieceSizes(count, spec, &actualBytes, &useLargePageSupport);
+    if (0 == totalActualBytes)
+        return NULL;
+    
     // Reserve the entire virtual address space on the first NUMA node.
+    // When large-page support is in use, the base is large-page aligned, so every piece boundary below falls on a large-page boundary.
     void* allocatedBuffer = siloOSMemoryAllocNUMA(totalActualBytes, topoGetNUMANodeOSIndex(spec[0].numaNode));
     if (NULL == allocatedBuffer)
         return NULL;
@@ -143,11 +580,17 @@ void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
         moveBaseAddress += actualBytes[i];
     }
     
-    // Submit the allocated buffer to the pointer map.
+    // Submit the allocated buffer to the pointer map as a single mapping, along with the layout of its pieces.
     SSiloAllocationSpec allocatedSpec;
     allocatedSpec.ptr = allocatedBuffer;
     allocatedSpec.size = totalActualBytes;
     siloPointerMapSubmit(1, &allocatedSpec);
     
+    std::vector<SSiloMemorySpec> allocatedPieces(spec, spec + count);
+    for (uint32_t i = 0; i < count; ++i)
+        allocatedPieces[i].size = actualBytes[i];
+    
+    siloPointerMapSubmitLayout(allocatedBuffer, count, &allocatedPieces[0]);
+    
     return allocatedBuffer;
 }
@@ -24,6 +24,13 @@
 #include <Windows.h>
 
 
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Number of times to attempt placing an aligned allocation before giving up.
+/// An attempt fails only if another thread claims the chosen address range in the meantime.
+static const uint32_t kSiloWindowsAlignedAllocAttempts = 16;
+
+
 // -------- INTERNAL FUNCTIONS --------------------------------------------- //
 
 /// Allocates virtual memory at the specified starting address, optionally using large-page support.
@@ -39,6 +46,34 @@ static void* siloWindowsMemoryAllocAtNUMA(size_t size, uint32_t numaNode, void*
     return VirtualAllocExNuma(GetCurrentProcess(), startPtr, size, MEM_RESERVE | (shouldCommit ? MEM_COMMIT : 0) | (useLargePageSupport ? MEM_LARGE_PAGES : 0), PAGE_READWRITE, numaNode);
 }
 
+// --------
+
+/// Allocates and commits virtual memory using small pages, with a base address aligned to the specified boundary.
+/// Part of a reservation cannot be released, so this reserves enough address space to contain an aligned region, releases it, and then allocates at the aligned address within it, retrying if another thread takes that address first.
+/// This is a Windows-specific helper function.
+/// @param [in] size Number of bytes to allocate.
+/// @param [in] alignment Required alignment of the base address, which must be a multiple of the allocation granularity.
+/// @param [in] numaNode OS-specific index of the NUMA node on which to allocate the memory.
+/// @return Pointer to the start of the allocated buffer, or NULL on allocation failure.
+static void* siloWindowsMemoryAllocAlignedNUMA(size_t size, size_t alignment, uint32_t numaNode)
+{
+    for (uint32_t i = 0; i < kSiloWindowsAlignedAllocAttempts; ++i)
+    {
+        void* reservation = VirtualAlloc(NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+        if (NULL == reservation)
+            return NULL;
+        
+        void* alignedBase = (void*)((((size_t)reservation + alignment - 1) / alignment) * alignment);
+        VirtualFree(reservation, 0, MEM_RELEASE);
+        
+        void* result = siloWindowsMemoryAllocAtNUMA(size, numaNode, alignedBase, true, false);
+        if (NULL != result)
+            return result;
+    }
+    
+    return NULL;
+}
+
 
 // -------- FUNCTIONS ------------------------------------------------------ //
 // See "osmemory.h" for documentation.
@@ -83,21 +118,92 @@ int32_t siloOSMemoryGetNUMANodeForVirtualAddress(void* address)
 
 // --------
 
+int32_t siloOSMemoryGetCurrentNUMANode(void)
+{
+    PROCESSOR_NUMBER processorNumber;
+    USHORT numaNode;
+
+    // Query the operating system to determine the NUMA node identifier for the current thread.
+    GetCurrentProcessorNumberEx(&processorNumber);
+    if (0 == GetNumaProcessorNodeEx(&processorNumber, &numaNode))
+        return -1;
+    
+    return (int32_t)numaNode;
+}
+
+// --------
+
+size_t siloOSMemoryGetNUMANodeFreeSize(uint32_t numaNode)
+{
+    ULONGLONG freeBytes = 0;
+    
+    if (0 == GetNumaAvailableMemoryNodeEx((USHORT)numaNode, &freeBytes))
+        return 0;
+    
+    return (size_t)freeBytes;
+}
+
+// --------
+
+uint32_t siloOSMemoryGetNUMANodeProcessorCount(uint32_t numaNode)
+{
+    GROUP_AFFINITY processorAffinity;
+    uint32_t processorCount = 0;
+    
+    if (0 == GetNumaNodeProcessorMaskEx((USHORT)numaNode, &processorAffinity))
+        return 0;
+    
+    for (KAFFINITY processorMask = processorAffinity.Mask; 0 != processorMask; processorMask &= (processorMask - 1))
+        processorCount += 1;
+    
+    return processorCount;
+}
+
+// --------
+
 void* siloOSMemoryAllocNUMA(size_t size, uint32_t numaNode)
 {
-    return siloWindowsMemoryAllocAtNUMA(size, numaNode, NULL, true, siloOSMemoryShouldAutoEnableLargePageSupport(size));
+    if (false == siloOSMemoryShouldAutoEnableLargePageSupport(size))
+        return siloWindowsMemoryAllocAtNUMA(size, numaNode, NULL, true, false);
+    
+    void* result = siloWindowsMemoryAllocAtNUMA(size, numaNode, NULL, true, true);
+    
+    // Large pages require the SeLockMemoryPrivilege privilege, which most processes lack.
+    // Fall back to small pages, but keep the large-page alignment that callers such as the small-object allocator rely on.
+    if (NULL == result)
+        result = siloWindowsMemoryAllocAlignedNUMA(size, siloOSMemoryGetGranularity(true), numaNode);
+    
+    return result;
 }
 
 // --------
 
-void* siloOSMemoryAllocLocalNUMA(size_t size)
+bool siloOSMemoryAllocNUMABatch(uint32_t count, const size_t* sizes, uint32_t numaNode, void** ptrs)
 {
-    PROCESSOR_NUMBER processorNumber;
-    USHORT numaNode;
+    // Each buffer must be a separate reservation so that it can be released individually.
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ptrs[i] = siloOSMemoryAllocNUMA(sizes[i], numaNode);
+        
+        if (NULL == ptrs[i])
+        {
+            // Roll back the buffers that were already allocated.
+            for (uint32_t j = 0; j < i; ++j)
+                siloOSMemoryFreeNUMA(ptrs[j], sizes[j]);
+            
+            return false;
+        }
+    }
+    
+    return true;
+}
 
-    // Query the operating system to determine the NUMA node identifier for the current thread.
-    GetCurrentProcessorNumberEx(&processorNumber);
-    if (0 == GetNumaProcessorNodeEx(&processorNumber, &numaNode))
+// --------
+
+void* siloOSMemoryAllocLocalNUMA(size_t size)
+{
+    const int32_t numaNode = siloOSMemoryGetCurrentNUMANode();
+    if (0 > numaNode)
         return NULL;
     
     return siloOSMemoryAllocNUMA(size, (uint32_t)numaNode);
@@ -112,42 +218,123 @@ void siloOSMemoryFreeNUMA(void* ptr, size_t size)
 
 // --------
 
-void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
+void siloOSMemoryFreeNUMABatch(uint32_t count, const SSiloAllocationSpec* specs)
 {
-    // Figure out if large page support is worth it.
-    size_t totalRequestedBytes = 0;
-    
+    // Reservations cannot be released together, so release them one at a time.
     for (uint32_t i = 0; i < count; ++i)
-        totalRequestedBytes += spec[i].size;
-    
-    const bool useLargePageSupport = siloOSMemoryShouldAutoEnableLargePageSupport(totalRequestedBytes);
+        siloOSMemoryFreeNUMA(specs[i].ptr, specs[i].size);
+}
+
+// --------
+
+bool siloOSMemoryCollapseLargePages(void* ptr, size_t size)
+{
+    // Large pages on Windows are allocated up-front rather than collapsed after the fact, so there is nothing to do.
+    return false;
+}
+
+// --------
+
+size_t siloOSMemoryGetLargePageBackedSize(void* ptr, size_t size)
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
     
-    // Get the minimum allocation unit size.
-    const size_t allocationUnitSize = siloOSMemoryGetGranularity(useLargePageSupport);
+    const size_t smallPageSize = (size_t)systemInfo.dwPageSize;
+    const size_t largePageSize = (size_t)GetLargePageMinimum();
     
-    // Compute the total number of bytes requested and granted, and simultaneously verify the passed NUMA node indices.
-    size_t totalActualBytes = 0;
-    std::vector<size_t> actualBytes(count);
+    size_t backedBytes = 0;
+    size_t offset = 0;
     
-    for (uint32_t i = 0; i < count; ++i)
+    // Walk the region, skipping over an entire large page whenever one is found.
+    while (offset < size)
     {
-        if (0 > topoGetNUMANodeOSIndex(spec[i].numaNode))
-            return NULL;
+        PSAPI_WORKING_SET_EX_INFORMATION addressInfo;
+        addressInfo.VirtualAddress = (void*)((size_t)ptr + offset);
+        
+        if (0 == QueryWorkingSetEx(GetCurrentProcess(), (void*)&addressInfo, sizeof(addressInfo)))
+            break;
         
-        actualBytes[i] = siloOSMemoryRoundAllocationSize(spec[i].size, useLargePageSupport);
-        totalActualBytes += actualBytes[i];
+        if ((addressInfo.VirtualAttributes.Valid) && (addressInfo.VirtualAttributes.LargePage) && (0 != largePageSize))
+        {
+            backedBytes += largePageSize;
+            offset += largePageSize;
+        }
+        else
+        {
+            offset += smallPageSize;
+        }
     }
     
-    // Verify that sufficient space was actually allocated on each node to justify even using this function.
-    if (0 == totalActualBytes)
-        return NULL;
+    return (backedBytes < size ? backedBytes : size);
+}
+
+// --------
+
+bool siloOSMemoryApplyHint(void* ptr, size_t size, ESiloMemoryHint hint)
+{
+    if (0 == size)
+        return false;
     
-    // Add sufficient additional space to allocate to the last NUMA node to ensure coverage of the total requested size.
-    while (totalActualBytes < totalRequestedBytes)
+    switch (hint)
     {
-        totalActualBytes += allocationUnitSize;
-        actualBytes[count - 1] += allocationUnitSize;
+    case SiloMemoryHintWillNeed:
+        {
+            WIN32_MEMORY_RANGE_ENTRY prefetchRange;
+            prefetchRange.VirtualAddress = ptr;
+            prefetchRange.NumberOfBytes = size;
+            return (FALSE != PrefetchVirtualMemory(GetCurrentProcess(), 1, &prefetchRange, 0));
+        }
+        
+    case SiloMemoryHintPageOut:
+        // Unlocking pages that are not locked removes them from the working set, which is the closest equivalent.
+        VirtualUnlock(ptr, size);
+        return true;
+        
+    case SiloMemoryHintLock:
+        return (FALSE != VirtualLock(ptr, size));
+        
+    case SiloMemoryHintUnlock:
+        return (FALSE != VirtualUnlock(ptr, size));
+        
+    default:
+        // Windows offers no equivalent for the remaining hints.
+        return false;
     }
+}
+
+// --------
+
+bool siloOSMemoryRelease(void* ptr, size_t size, ESiloReleaseMode mode)
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    
+    const size_t pageSize = (size_t)systemInfo.dwPageSize;
+    const size_t regionStart = (((size_t)ptr + pageSize - 1) / pageSize) * pageSize;
+    const size_t regionEnd = (((size_t)ptr + size) / pageSize) * pageSize;
+    
+    if (regionEnd <= regionStart)
+        return true;
+    
+    // Resetting memory lets the system discard it lazily, but there is no way to discard it immediately without also decommitting it.
+    if (SiloReleaseModeLazy != mode)
+        return false;
+    
+    return (NULL != VirtualAlloc((void*)regionStart, regionEnd - regionStart, MEM_RESET, PAGE_READWRITE));
+}
+
+// --------
+
+void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
+{
+    // Determine the size of each piece.
+    std::vector<size_t> actualBytes;
+    bool useLargePageSupport = false;
+    
+    const size_t totalActualBytes = siloOSMemoryComputeMultiNUMAPieceSizes(count, spec, &actualBytes, &useLargePageSupport);
+    if (0 == totalActualBytes)
+        return NULL;
 
     // Reserve the entire virtual address space, as a way of checking for sufficient virtual address space and getting a base address.
     void* allocatedBuffer = siloWindowsMemoryAllocAtNUMA(totalActualBytes, 0, NULL, false, useLargePageSupport);
@@ -195,6 +382,12 @@ void* siloOSMemoryAllocMultiNUMA(uint32_t count, const SSiloMemorySpec* spec)
         // If succeeded, return the base address of the allocated multi-node array and store its metadata.
         allocatedBuffer = allocationSpecs[0].ptr;
         siloPointerMapSubmit(numAllocated, allocationSpecs);
+        
+        std::vector<SSiloMemorySpec> allocatedPieces(spec, spec + count);
+        for (uint32_t i = 0; i < count; ++i)
+            allocatedPieces[i].size = actualBytes[i];
+        
+        siloPointerMapSubmitLayout(allocatedBuffer, count, &allocatedPieces[0]);
     }
     
     delete[] allocationSpecs;
@@ -14,6 +14,10 @@
 
 #include "osmemory.h"
 
+#include <cstdint>
+#include <topo.h>
+#include <vector>
+
 
 // -------- CONSTANTS ------------------------------------------------------ //
 
@@ -43,3 +47,45 @@ bool siloOSMemoryShouldAutoEnableLargePageSupport(size_t unroundedSize)
 {
     return (unroundedSize >= kSiloAutoLargePageMinimumSize);
 }
+
+// --------
+
+size_t siloOSMemoryComputeMultiNUMAPieceSizes(uint32_t count, const SSiloMemorySpec* spec, std::vector<size_t>* actualBytes, bool* useLargePageSupport)
+{
+    // Figure out if large page support is worth it.
+    size_t totalRequestedBytes = 0;
+    
+    for (uint32_t i = 0; i < count; ++i)
+        totalRequestedBytes += spec[i].size;
+    
+    *useLargePageSupport = siloOSMemoryShouldAutoEnableLargePageSupport(totalRequestedBytes);
+    
+    // Get the minimum allocation unit size.
+    const size_t allocationUnitSize = siloOSMemoryGetGranularity(*useLargePageSupport);
+    
+    // Compute the total number of bytes requested and granted, and simultaneously verify the passed NUMA node indices.
+    size_t totalActualBytes = 0;
+    actualBytes->assign(count, 0);
+    
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (0 > topoGetNUMANodeOSIndex(spec[i].numaNode))
+            return 0;
+        
+        (*actualBytes)[i] = siloOSMemoryRoundAllocationSize(spec[i].size, *useLargePageSupport);
+        totalActualBytes += (*actualBytes)[i];
+    }
+    
+    // Verify that sufficient space was actually allocated on each node to justify even using this function.
+    if (0 == totalActualBytes)
+        return 0;
+    
+    // Add sufficient additional space to allocate to the last NUMA node to ensure coverage of the total requested size.
+    while (totalActualBytes < totalRequestedBytes)
+    {
+        totalActualBytes += allocationUnitSize;
+        (*actualBytes)[count - 1] += allocationUnitSize;
+    }
+    
+    return totalActualBytes;
+}
@@ -0,0 +1,278 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file partition.cpp
+ *   Implementation of helpers for automatically partitioning multi-node arrays.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "osmemory.h"
+#include "partition.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <topo.h>
+#include <vector>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Fraction of each node's free memory, expressed as a divisor, that is left unused by automatic layouts.
+/// Leaves room for the page cache, kernel allocations, and the page tables of the array itself, which would otherwise push the last pieces onto other nodes.
+static const size_t kSiloPartitionHeadroomDivisor = 16;
+
+/// Minimum amount of each node's free memory, in bytes, that is left unused by automatic layouts.
+static const size_t kSiloPartitionMinimumHeadroom = 67108864;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Holds information about a NUMA node being considered as part of a multi-node array layout.
+struct SSiloPartitionCandidate
+{
+    uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node.
+    size_t capacityUnits;                                                   ///< Number of allocation units that fit in the node's free memory, less headroom.
+    size_t weight;                                                          ///< Relative share of the array this node should receive.
+    size_t assignedUnits;                                                   ///< Number of allocation units assigned to this node so far.
+};
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Determines how much of a node's free memory an automatic layout may use.
+/// @param [in] numaNodeOSIndex OS-specific index of the NUMA node.
+/// @return Number of usable bytes, which is the free memory less a safety margin.
+static size_t siloPartitionGetUsableSize(uint32_t numaNodeOSIndex)
+{
+    const size_t freeBytes = siloOSMemoryGetNUMANodeFreeSize(numaNodeOSIndex);
+    const size_t headroomBytes = std::max(freeBytes / kSiloPartitionHeadroomDivisor, kSiloPartitionMinimumHeadroom);
+
+    return ((freeBytes > headroomBytes) ? (freeBytes - headroomBytes) : 0);
+}
+
+// --------
+
+/// Distributes allocation units among candidates in proportion to their weights, without exceeding the capacity of any candidate.
+/// Candidates whose proportional share does not fit are filled to capacity and the remainder is redistributed among the others.
+/// @param [in] totalUnits Number of allocation units to distribute.
+/// @param [in,out] candidates Candidate NUMA nodes, whose assigned unit counts are updated.
+/// @return `true` if all units were distributed, `false` otherwise.
+static bool siloPartitionDistributeProportionally(size_t totalUnits, std::vector<SSiloPartitionCandidate>& candidates)
+{
+    std::vector<bool> isActive(candidates.size(), true);
+    size_t remainingUnits = totalUnits;
+
+    while (0 != remainingUnits)
+    {
+        // Sum the weights of the candidates that can still accept more units.
+        size_t totalWeight = 0;
+
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (true == isActive[i])
+                totalWeight += candidates[i].weight;
+        }
+
+        // If the remaining candidates carry no weight, for example memory-only nodes when balancing by processors, fall back to their free memory.
+        if (0 == totalWeight)
+        {
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                if (true == isActive[i])
+                {
+                    candidates[i].weight = candidates[i].capacityUnits - candidates[i].assignedUnits;
+                    totalWeight += candidates[i].weight;
+                }
+            }
+
+            if (0 == totalWeight)
+                return false;
+        }
+
+        // Compute each active candidate's proportional share, handing out leftover units by largest remainder.
+        std::vector<size_t> shares(candidates.size(), 0);
+        std::vector<size_t> remainders(candidates.size(), 0);
+        size_t distributedUnits = 0;
+
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (true == isActive[i])
+            {
+                shares[i] = (remainingUnits * candidates[i].weight) / totalWeight;
+                remainders[i] = (remainingUnits * candidates[i].weight) % totalWeight;
+                distributedUnits += shares[i];
+            }
+        }
+
+        while (distributedUnits < remainingUnits)
+        {
+            size_t bestIndex = candidates.size();
+
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                if ((true == isActive[i]) && (0 != candidates[i].weight) && ((candidates.size() == bestIndex) || (remainders[i] > remainders[bestIndex])))
+                    bestIndex = i;
+            }
+
+            shares[bestIndex] += 1;
+            remainders[bestIndex] = 0;
+            distributedUnits += 1;
+        }
+
+        // Any candidate whose share does not fit is filled to capacity and removed from consideration.
+        bool anyCandidateFilled = false;
+
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            const size_t availableUnits = candidates[i].capacityUnits - candidates[i].assignedUnits;
+
+            if ((true == isActive[i]) && (shares[i] >= availableUnits))
+            {
+                candidates[i].assignedUnits += availableUnits;
+                remainingUnits -= availableUnits;
+                isActive[i] = false;
+                anyCandidateFilled = true;
+            }
+        }
+
+        // If every share fit, assign them and finish.
+        if (false == anyCandidateFilled)
+        {
+            for (size_t i = 0; i < candidates.size(); ++i)
+                candidates[i].assignedUnits += shares[i];
+
+            remainingUnits = 0;
+        }
+    }
+
+    return true;
+}
+
+// --------
+
+/// Distributes allocation units among as few candidates as possible by filling the candidates with the most free memory first.
+/// @param [in] totalUnits Number of allocation units to distribute.
+/// @param [in,out] candidates Candidate NUMA nodes, whose assigned unit counts are updated.
+/// @return `true` if all units were distributed, `false` otherwise.
+static bool siloPartitionDistributeMinimumNodes(size_t totalUnits, std::vector<SSiloPartitionCandidate>& candidates)
+{
+    std::vector<size_t> order(candidates.size());
+
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&candidates](size_t a, size_t b) { return candidates[a].capacityUnits > candidates[b].capacityUnits; });
+
+    size_t remainingUnits = totalUnits;
+
+    for (size_t i = 0; (i < order.size()) && (0 != remainingUnits); ++i)
+    {
+        SSiloPartitionCandidate& candidate = candidates[order[i]];
+
+        candidate.assignedUnits = std::min(candidate.capacityUnits, remainingUnits);
+        remainingUnits -= candidate.assignedUnits;
+    }
+
+    return (0 == remainingUnits);
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "partition.h" for documentation.
+
+bool siloPartitionPlan(size_t size, uint64_t nodeMask, ESiloPartitionGoal goal, std::vector<SSiloMemorySpec>* plan)
+{
+    plan->clear();
+
+    if (0 == size)
+        return false;
+
+    // Determine the allocation granularity that will be used for the array.
+    // Rounding up to whole small pages can push the total over the large-page threshold, in which case large pages are used instead.
+    size_t allocationUnitSize = siloOSMemoryGetGranularity(siloOSMemoryShouldAutoEnableLargePageSupport(size));
+    size_t totalUnits = (size + allocationUnitSize - 1) / allocationUnitSize;
+
+    if (siloOSMemoryShouldAutoEnableLargePageSupport(totalUnits * allocationUnitSize))
+    {
+        allocationUnitSize = siloOSMemoryGetGranularity(true);
+        totalUnits = (size + allocationUnitSize - 1) / allocationUnitSize;
+    }
+
+    // Gather information about each candidate NUMA node.
+    const uint32_t numNumaNodes = std::min((uint32_t)64, topoGetSystemNUMANodeCount());
+    std::vector<SSiloPartitionCandidate> candidates;
+    size_t totalCapacityUnits = 0;
+
+    for (uint32_t i = 0; i < numNumaNodes; ++i)
+    {
+        if (0 == (nodeMask & ((uint64_t)1 << i)))
+            continue;
+
+        const int32_t numaNodeOSIndex = topoGetNUMANodeOSIndex(i);
+        if (0 > numaNodeOSIndex)
+            continue;
+
+        SSiloPartitionCandidate candidate;
+        candidate.numaNode = i;
+        candidate.capacityUnits = siloPartitionGetUsableSize((uint32_t)numaNodeOSIndex) / allocationUnitSize;
+        candidate.assignedUnits = 0;
+
+        switch (goal)
+        {
+        case SiloPartitionGoalBalancedByProcessors:
+            candidate.weight = siloOSMemoryGetNUMANodeProcessorCount((uint32_t)numaNodeOSIndex);
+            break;
+
+        default:
+            candidate.weight = candidate.capacityUnits;
+            break;
+        }
+
+        totalCapacityUnits += candidate.capacityUnits;
+        candidates.push_back(candidate);
+    }
+
+    if (totalCapacityUnits < totalUnits)
+        return false;
+
+    // Distribute the array according to the requested goal.
+    bool distributionSuccessful = false;
+
+    switch (goal)
+    {
+    case SiloPartitionGoalBalancedByProcessors:
+    case SiloPartitionGoalBalancedByFreeMemory:
+        distributionSuccessful = siloPartitionDistributeProportionally(totalUnits, candidates);
+        break;
+
+    case SiloPartitionGoalMinimumNodeCount:
+        distributionSuccessful = siloPartitionDistributeMinimumNodes(totalUnits, candidates);
+        break;
+
+    default:
+        break;
+    }
+
+    if (false == distributionSuccessful)
+        return false;
+
+    // Produce the layout, omitting nodes that received nothing.
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        if (0 != candidates[i].assignedUnits)
+        {
+            SSiloMemorySpec piece;
+            piece.size = candidates[i].assignedUnits * allocationUnitSize;
+            piece.numaNode = candidates[i].numaNode;
+            plan->push_back(piece);
+        }
+    }
+
+    return true;
+}
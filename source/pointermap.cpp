@@ -25,9 +25,14 @@
 
 /// Holds all information about memory allocated through this library.
 /// Maps base address information to size (for end-user convenience) and tracks piece-wise allocations of multi-node arrays.
-static std::unordered_map<void*, const std::vector<SSiloAllocationSpec>*> siloPointerMap;
+/// Allocated once and never destroyed, so that memory can still be freed by exit handlers and static destructors that run after those of this library.
+static std::unordered_map<void*, const std::vector<SSiloAllocationSpec>*>& siloPointerMap = *new std::unordered_map<void*, const std::vector<SSiloAllocationSpec>*>;
 
-/// Used as a lock to guard access to #siloPointerMap.
+/// Maps the base address of each multi-node array to its piece-wise layout.
+/// Every key is also present in #siloPointerMap. Never destroyed, for the same reason.
+static std::unordered_map<void*, std::vector<SSiloMemorySpec>>& siloPointerMapLayouts = *new std::unordered_map<void*, std::vector<SSiloMemorySpec>>;
+
+/// Used as a lock to guard access to #siloPointerMap and #siloPointerMapLayouts.
 static std::mutex siloPointerMapLock;
 
 
@@ -61,6 +66,54 @@ const std::vector<SSiloAllocationSpec>* siloPointerMapSubmit(uint32_t count, con
 
 // --------
 
+bool siloPointerMapSubmitBatch(uint32_t count, const SSiloAllocationSpec* specs)
+{
+    std::lock_guard<std::mutex> siloPointerMapLocalGuard(siloPointerMapLock);
+    
+    // Check all of the base addresses before adding any of them, so that a failure leaves the map unchanged.
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (0 != siloPointerMap.count(specs[i].ptr))
+            return false;
+    }
+    
+    siloPointerMap.reserve(siloPointerMap.size() + count);
+    
+    for (uint32_t i = 0; i < count; ++i)
+        siloPointerMap.insert({specs[i].ptr, new std::vector<SSiloAllocationSpec>(1, specs[i])});
+    
+    return true;
+}
+
+// --------
+
+bool siloPointerMapSubmitLayout(void* ptr, uint32_t count, const SSiloMemorySpec* pieces)
+{
+    std::lock_guard<std::mutex> siloPointerMapLocalGuard(siloPointerMapLock);
+
+    if ((0 == siloPointerMap.count(ptr)) || (0 != siloPointerMapLayouts.count(ptr)))
+        return false;
+
+    siloPointerMapLayouts.insert({ptr, std::vector<SSiloMemorySpec>(pieces, pieces + count)});
+    return true;
+}
+
+// --------
+
+bool siloPointerMapRetrieveLayout(void* ptr, std::vector<SSiloMemorySpec>* pieces)
+{
+    std::lock_guard<std::mutex> siloPointerMapLocalGuard(siloPointerMapLock);
+
+    std::unordered_map<void*, std::vector<SSiloMemorySpec>>::const_iterator layoutIterator = siloPointerMapLayouts.find(ptr);
+    if (siloPointerMapLayouts.end() == layoutIterator)
+        return false;
+
+    *pieces = layoutIterator->second;
+    return true;
+}
+
+// --------
+
 const std::vector<SSiloAllocationSpec>* siloPointerMapRetrieve(void* ptr)
 {
     std::lock_guard<std::mutex> siloPointerMapLocalGuard(siloPointerMapLock);
@@ -83,5 +136,32 @@ void siloPointerMapDelete(void* ptr)
     {
         delete siloPointerMap[ptr];
         siloPointerMap.erase(ptr);
+        siloPointerMapLayouts.erase(ptr);
+    }
+}
+
+// --------
+
+void siloPointerMapDeleteBatch(uint32_t count, void* const* ptrs, std::vector<SSiloAllocationSpec>* removedSpecs, std::vector<void*>* unknownPtrs)
+{
+    std::lock_guard<std::mutex> siloPointerMapLocalGuard(siloPointerMapLock);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (NULL == ptrs[i])
+            continue;
+        
+        std::unordered_map<void*, const std::vector<SSiloAllocationSpec>*>::iterator allocationIterator = siloPointerMap.find(ptrs[i]);
+        
+        if (siloPointerMap.end() == allocationIterator)
+        {
+            unknownPtrs->push_back(ptrs[i]);
+            continue;
+        }
+        
+        removedSpecs->insert(removedSpecs->end(), allocationIterator->second->begin(), allocationIterator->second->end());
+        delete allocationIterator->second;
+        siloPointerMap.erase(allocationIterator);
+        siloPointerMapLayouts.erase(ptrs[i]);
     }
 }
@@ -0,0 +1,334 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file sharedmemory-linux.cpp
+ *   Implementation of multi-node arrays shared between processes.
+ *   This file contains Linux-specific functions.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "osmemory.h"
+#include "pointermap.h"
+#include "sharedmemory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <numa.h>
+#include <string>
+#include <topo.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Identifies a shared memory object as holding a Silo multi-node array.
+static const uint64_t kSiloSharedMemoryMagic = 0x59415252414f4c53ull;
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Describes the layout of a shared multi-node array.
+/// Stored at the start of the shared memory object and followed immediately by one #SSiloSharedMemoryPiece per piece.
+struct SSiloSharedMemoryHeader
+{
+    uint64_t magic;                                                         ///< Set to #kSiloSharedMemoryMagic.
+    uint32_t isReady;                                                       ///< Set to non-zero once the creating process has finished initializing the object.
+    uint32_t count;                                                         ///< Number of pieces in the array.
+    uint64_t dataOffset;                                                    ///< Offset, in bytes, of the array within the shared memory object.
+    uint64_t arraySize;                                                     ///< Sum of the sizes of all pieces, in bytes.
+    uint64_t mappedSize;                                                    ///< Number of bytes mapped for the array, which may include padding after the last piece.
+};
+
+/// Describes a single piece of a shared multi-node array.
+struct SSiloSharedMemoryPiece
+{
+    uint64_t size;                                                          ///< Actual size of the piece, in bytes.
+    uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node that backs the piece.
+    uint32_t reserved;                                                      ///< Unused, set to zero.
+};
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Converts a user-supplied name into a name suitable for the POSIX shared memory functions.
+/// This is a Linux-specific helper function.
+/// @param [in] name User-supplied name, which may or may not begin with a slash.
+/// @return Name that begins with exactly one slash.
+static std::string siloLinuxSharedMemoryGetObjectName(const char* name)
+{
+    if ('/' == name[0])
+        return std::string(name);
+    else
+        return std::string("/") + name;
+}
+
+// --------
+
+/// Maps part of a shared memory object at a virtual address aligned to the specified boundary.
+/// This is a Linux-specific helper function.
+/// @param [in] fd File descriptor of the shared memory object.
+/// @param [in] offset Offset within the object at which to start the mapping, which must be a multiple of the page size.
+/// @param [in] size Number of bytes to map.
+/// @param [in] alignment Required alignment of the base address, which must be a multiple of the page size.
+/// @return Pointer to the start of the mapped region, or NULL on failure.
+static void* siloLinuxSharedMemoryMapAligned(int fd, size_t offset, size_t size, size_t alignment)
+{
+    void* reservation = mmap(NULL, size + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == reservation)
+        return NULL;
+
+    const size_t reservationBase = (size_t)reservation;
+    const size_t alignedBase = ((reservationBase + alignment - 1) / alignment) * alignment;
+    const size_t headBytes = alignedBase - reservationBase;
+    const size_t tailBytes = alignment - headBytes;
+
+    if (MAP_FAILED == mmap((void*)alignedBase, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, (off_t)offset))
+    {
+        munmap(reservation, size + alignment);
+        return NULL;
+    }
+
+    if (0 != headBytes)
+        munmap(reservation, headBytes);
+
+    if (0 != tailBytes)
+        munmap((void*)(alignedBase + size), tailBytes);
+
+    return (void*)alignedBase;
+}
+
+// --------
+
+/// Reads and validates the header of a shared multi-node array.
+/// This is a Linux-specific helper function.
+/// @param [in] fd File descriptor of the shared memory object.
+/// @param [out] header Filled with the header contents.
+/// @return `true` if the header is valid and the object has been fully initialized, `false` otherwise.
+static bool siloLinuxSharedMemoryReadHeader(int fd, SSiloSharedMemoryHeader* header)
+{
+    struct stat objectInfo;
+
+    if (0 != fstat(fd, &objectInfo))
+        return false;
+
+    if (sizeof(*header) != pread(fd, header, sizeof(*header), 0))
+        return false;
+
+    if ((kSiloSharedMemoryMagic != header->magic) || (0 == header->isReady))
+        return false;
+
+    return ((uint64_t)objectInfo.st_size >= (header->dataOffset + header->mappedSize));
+}
+
+// --------
+
+/// Reads the piece-wise layout that follows the header of a shared multi-node array.
+/// This is a Linux-specific helper function.
+/// @param [in] fd File descriptor of the shared memory object.
+/// @param [in] header Header previously read using siloLinuxSharedMemoryReadHeader().
+/// @param [out] pieces Filled with the actual size and NUMA node of each piece.
+/// @return `true` if the layout was read, `false` otherwise.
+static bool siloLinuxSharedMemoryReadPieces(int fd, const SSiloSharedMemoryHeader& header, std::vector<SSiloMemorySpec>* pieces)
+{
+    const uint32_t count = header.count;
+    const uint64_t bytesToRead = (uint64_t)sizeof(SSiloSharedMemoryPiece) * count;
+
+    // The layout must fit between the header and the data.
+    if ((0 == count) || ((sizeof(SSiloSharedMemoryHeader) + bytesToRead) > header.dataOffset))
+        return false;
+
+    std::vector<SSiloSharedMemoryPiece> storedPieces(count);
+
+    if ((ssize_t)bytesToRead != pread(fd, &storedPieces[0], (size_t)bytesToRead, sizeof(SSiloSharedMemoryHeader)))
+        return false;
+
+    pieces->resize(count);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        (*pieces)[i].size = (size_t)storedPieces[i].size;
+        (*pieces)[i].numaNode = storedPieces[i].numaNode;
+    }
+
+    return true;
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "sharedmemory.h" for documentation.
+
+void* siloSharedMemoryCreateMultiNUMA(const char* name, uint32_t count, const SSiloMemorySpec* spec)
+{
+    // Determine the size of each piece exactly as for a private multi-node array.
+    std::vector<size_t> actualBytes;
+    bool useLargePageSupport = false;
+
+    const size_t arraySize = siloOSMemoryComputeMultiNUMAPieceSizes(count, spec, &actualBytes, &useLargePageSupport);
+    if (0 == arraySize)
+        return NULL;
+
+    // Pad the array so that freeing it unmaps exactly what was mapped, and place it after the header at an offset that preserves large-page alignment.
+    const size_t alignment = siloOSMemoryGetGranularity(siloOSMemoryShouldAutoEnableLargePageSupport(arraySize));
+    const size_t mappedSize = ((arraySize + alignment - 1) / alignment) * alignment;
+    const size_t headerSize = sizeof(SSiloSharedMemoryHeader) + (sizeof(SSiloSharedMemoryPiece) * count);
+    const size_t dataOffset = ((headerSize + alignment - 1) / alignment) * alignment;
+
+    // Create the shared memory object. Failing if it already exists prevents two processes from initializing the same array.
+    const std::string objectName = siloLinuxSharedMemoryGetObjectName(name);
+    const int fd = shm_open(objectName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (0 > fd)
+        return NULL;
+
+    void* allocatedBuffer = NULL;
+
+    if (0 == ftruncate(fd, (off_t)(dataOffset + mappedSize)))
+        allocatedBuffer = siloLinuxSharedMemoryMapAligned(fd, dataOffset, mappedSize, alignment);
+
+    if (NULL == allocatedBuffer)
+    {
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return NULL;
+    }
+
+    // Bind each piece to its NUMA node. For shared mappings the policy is attached to the object itself, so it applies to every process that maps it.
+    // Any padding after the last piece is bound along with it.
+    uint8_t* bindBaseAddress = (uint8_t*)allocatedBuffer;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const size_t bindBytes = ((count - 1) == i ? mappedSize - (size_t)(bindBaseAddress - (uint8_t*)allocatedBuffer) : actualBytes[i]);
+
+        if (0 != bindBytes)
+            numa_tonode_memory((void*)bindBaseAddress, bindBytes, topoGetNUMANodeOSIndex(spec[i].numaNode));
+
+        bindBaseAddress += actualBytes[i];
+    }
+
+    if (true == siloOSMemoryShouldAutoEnableLargePageSupport(mappedSize))
+        madvise(allocatedBuffer, mappedSize, MADV_HUGEPAGE);
+
+    // Write the layout, marking the object ready only once everything else is in place.
+    std::vector<uint8_t> headerBytes(headerSize, 0);
+    SSiloSharedMemoryHeader* header = (SSiloSharedMemoryHeader*)&headerBytes[0];
+    SSiloSharedMemoryPiece* pieces = (SSiloSharedMemoryPiece*)&headerBytes[sizeof(SSiloSharedMemoryHeader)];
+
+    header->magic = kSiloSharedMemoryMagic;
+    header->isReady = 0;
+    header->count = count;
+    header->dataOffset = dataOffset;
+    header->arraySize = arraySize;
+    header->mappedSize = mappedSize;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pieces[i].size = actualBytes[i];
+        pieces[i].numaNode = spec[i].numaNode;
+    }
+
+    const uint32_t isReady = 1;
+
+    if ((headerSize != (size_t)pwrite(fd, &headerBytes[0], headerSize, 0)) || (sizeof(isReady) != pwrite(fd, &isReady, sizeof(isReady), offsetof(SSiloSharedMemoryHeader, isReady))))
+    {
+        munmap(allocatedBuffer, mappedSize);
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return NULL;
+    }
+
+    close(fd);
+
+    // Submit the mapped array to the pointer map, along with the layout of its pieces.
+    SSiloAllocationSpec allocatedSpec;
+    allocatedSpec.ptr = allocatedBuffer;
+    allocatedSpec.size = mappedSize;
+    siloPointerMapSubmit(1, &allocatedSpec);
+
+    std::vector<SSiloMemorySpec> allocatedPieces(spec, spec + count);
+    for (uint32_t i = 0; i < count; ++i)
+        allocatedPieces[i].size = actualBytes[i];
+
+    siloPointerMapSubmitLayout(allocatedBuffer, count, &allocatedPieces[0]);
+
+    return allocatedBuffer;
+}
+
+// --------
+
+void* siloSharedMemoryAttachMultiNUMA(const char* name, size_t* size)
+{
+    const std::string objectName = siloLinuxSharedMemoryGetObjectName(name);
+    const int fd = shm_open(objectName.c_str(), O_RDWR, 0);
+    if (0 > fd)
+        return NULL;
+
+    SSiloSharedMemoryHeader header;
+    std::vector<SSiloMemorySpec> allocatedPieces;
+    void* allocatedBuffer = NULL;
+
+    if ((true == siloLinuxSharedMemoryReadHeader(fd, &header)) && (true == siloLinuxSharedMemoryReadPieces(fd, header, &allocatedPieces)))
+        allocatedBuffer = siloLinuxSharedMemoryMapAligned(fd, (size_t)header.dataOffset, (size_t)header.mappedSize, siloOSMemoryGetGranularity(siloOSMemoryShouldAutoEnableLargePageSupport((size_t)header.mappedSize)));
+
+    close(fd);
+
+    if (NULL == allocatedBuffer)
+        return NULL;
+
+    // NUMA bindings are held by the shared object, but large-page advice applies only to this process' mapping.
+    if (true == siloOSMemoryShouldAutoEnableLargePageSupport((size_t)header.mappedSize))
+        madvise(allocatedBuffer, (size_t)header.mappedSize, MADV_HUGEPAGE);
+
+    // Submit the mapped array to the pointer map, along with the layout of its pieces.
+    SSiloAllocationSpec allocatedSpec;
+    allocatedSpec.ptr = allocatedBuffer;
+    allocatedSpec.size = (size_t)header.mappedSize;
+    siloPointerMapSubmit(1, &allocatedSpec);
+    siloPointerMapSubmitLayout(allocatedBuffer, (uint32_t)allocatedPieces.size(), &allocatedPieces[0]);
+
+    if (NULL != size)
+        *size = (size_t)header.arraySize;
+
+    return allocatedBuffer;
+}
+
+// --------
+
+uint32_t siloSharedMemoryGetLayout(const char* name, uint32_t maxCount, SSiloMemorySpec* spec)
+{
+    const std::string objectName = siloLinuxSharedMemoryGetObjectName(name);
+    const int fd = shm_open(objectName.c_str(), O_RDONLY, 0);
+    if (0 > fd)
+        return 0;
+
+    SSiloSharedMemoryHeader header;
+    std::vector<SSiloMemorySpec> pieces;
+    uint32_t count = 0;
+
+    if ((true == siloLinuxSharedMemoryReadHeader(fd, &header)) && (true == siloLinuxSharedMemoryReadPieces(fd, header, &pieces)))
+    {
+        count = header.count;
+
+        for (uint32_t i = 0; (i < count) && (i < maxCount); ++i)
+            spec[i] = pieces[i];
+    }
+
+    close(fd);
+    return count;
+}
+
+// --------
+
+bool siloSharedMemoryUnlink(const char* name)
+{
+    return (0 == shm_unlink(siloLinuxSharedMemoryGetObjectName(name).c_str()));
+}
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file sharedmemory-windows.cpp
+ *   Implementation of multi-node arrays shared between processes.
+ *   This file contains Windows-specific functions.
+ *   Shared multi-node arrays are not currently supported on Windows, so all functions fail.
+ *****************************************************************************/
+
+#include "../silo.h"
+#include "sharedmemory.h"
+
+#include <cstdint>
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "sharedmemory.h" for documentation.
+
+void* siloSharedMemoryCreateMultiNUMA(const char* name, uint32_t count, const SSiloMemorySpec* spec)
+{
+    return NULL;
+}
+
+// --------
+
+void* siloSharedMemoryAttachMultiNUMA(const char* name, size_t* size)
+{
+    return NULL;
+}
+
+// --------
+
+uint32_t siloSharedMemoryGetLayout(const char* name, uint32_t maxCount, SSiloMemorySpec* spec)
+{
+    return 0;
+}
+
+// --------
+
+bool siloSharedMemoryUnlink(const char* name)
+{
+    return false;
+}
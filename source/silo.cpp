@@ -11,14 +11,21 @@
  *   Implementation of all external API functions.
  *****************************************************************************/
 
+#include "colormemory.h"
 #include "consume.h"
 #include "osmemory.h"
+#include "partition.h"
 #include "pointermap.h"
+#include "sharedmemory.h"
+#include "smallalloc.h"
+#include "trace.h"
 
 #include <cstdint>
 #include <cstdlib>
 #include <malloc.h>
+#include <map>
 #include <topo.h>
+#include <vector>
 
 
 // -------- FUNCTIONS ------------------------------------------------------ //
@@ -45,6 +52,7 @@ int32_t siloGetNUMANodeForVirtualAddress(void* address)
 
 void* siloSimpleBufferAlloc(size_t size, uint32_t numaNode)
 {
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
     void* allocatedBuffer = NULL;
     int32_t numaNodeOSIndex = topoGetNUMANodeOSIndex(numaNode);
     
@@ -63,6 +71,7 @@ void* siloSimpleBufferAlloc(size_t size, uint32_t numaNode)
         siloPointerMapSubmit(1, &allocatedSpec);
     }
     
+    siloTraceRecordAllocation(SiloTraceOperationSimpleBufferAlloc, size, numaNode, 0, NULL, allocatedBuffer, traceStartTimestamp);
     return allocatedBuffer;
 }
 
@@ -70,6 +79,7 @@ void* siloSimpleBufferAlloc(size_t size, uint32_t numaNode)
 
 void* siloSimpleBufferAllocLocal(size_t size)
 {
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
     void* allocatedBuffer = siloOSMemoryAllocLocalNUMA(size);
 
     // If allocation was successful, add the address to the map.
@@ -82,34 +92,450 @@ void* siloSimpleBufferAllocLocal(size_t size)
         siloPointerMapSubmit(1, &allocatedSpec);
     }
 
+    siloTraceRecordAllocation(SiloTraceOperationSimpleBufferAllocLocal, size, kSiloTraceNoNode, 0, NULL, allocatedBuffer, traceStartTimestamp);
     return allocatedBuffer;
 }
 
 // --------
 
+int32_t siloAllocBatch(uint32_t count, const SSiloMemorySpec* specs, void** outPtrs)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    
+    // Group the requests by NUMA node, verifying along the way that every node index is within range.
+    std::map<int32_t, std::vector<uint32_t>> requestsByNode;
+    bool allocationSuccessful = true;
+    
+    for (uint32_t i = 0; i < count; ++i)
+        outPtrs[i] = NULL;
+    
+    for (uint32_t i = 0; (i < count) && (true == allocationSuccessful); ++i)
+    {
+        const int32_t numaNodeOSIndex = topoGetNUMANodeOSIndex(specs[i].numaNode);
+        
+        if ((0 > numaNodeOSIndex) || (0 == specs[i].size))
+            allocationSuccessful = false;
+        else
+            requestsByNode[numaNodeOSIndex].push_back(i);
+    }
+    
+    // Allocate all of the buffers for each node together, keeping track of what was allocated in case a later node fails.
+    std::vector<SSiloAllocationSpec> allocatedSpecs(count);
+    std::vector<size_t> nodeSizes;
+    std::vector<void*> nodePtrs;
+    uint32_t numAllocated = 0;
+    
+    for (std::map<int32_t, std::vector<uint32_t>>::const_iterator it = requestsByNode.begin(); (true == allocationSuccessful) && (it != requestsByNode.end()); ++it)
+    {
+        const std::vector<uint32_t>& nodeRequests = it->second;
+        
+        nodeSizes.resize(nodeRequests.size());
+        nodePtrs.resize(nodeRequests.size());
+        
+        for (size_t i = 0; i < nodeRequests.size(); ++i)
+            nodeSizes[i] = specs[nodeRequests[i]].size;
+        
+        if (false == siloOSMemoryAllocNUMABatch((uint32_t)nodeRequests.size(), &nodeSizes[0], (uint32_t)it->first, &nodePtrs[0]))
+        {
+            allocationSuccessful = false;
+            break;
+        }
+        
+        for (size_t i = 0; i < nodeRequests.size(); ++i)
+        {
+            outPtrs[nodeRequests[i]] = nodePtrs[i];
+            allocatedSpecs[numAllocated].ptr = nodePtrs[i];
+            allocatedSpecs[numAllocated].size = nodeSizes[i];
+            numAllocated += 1;
+        }
+    }
+    
+    // Add all of the buffers to the map at once.
+    if ((true == allocationSuccessful) && (0 != numAllocated))
+        allocationSuccessful = siloPointerMapSubmitBatch(numAllocated, &allocatedSpecs[0]);
+    
+    // If anything failed, release everything that was allocated so that the caller sees no partial result.
+    if (false == allocationSuccessful)
+    {
+        if (0 != numAllocated)
+            siloOSMemoryFreeNUMABatch(numAllocated, &allocatedSpecs[0]);
+        
+        for (uint32_t i = 0; i < count; ++i)
+            outPtrs[i] = NULL;
+    }
+    
+    // Trace each buffer as if it had been allocated individually, so that the trace can be replayed without knowledge of batching.
+    for (uint32_t i = 0; i < count; ++i)
+        siloTraceRecordAllocation(SiloTraceOperationSimpleBufferAlloc, specs[i].size, specs[i].numaNode, 0, NULL, outPtrs[i], traceStartTimestamp);
+    
+    return (allocationSuccessful ? 0 : -1);
+}
+
+// --------
+
+void* siloMalloc(size_t size, uint32_t numaNode)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    void* allocatedObject = siloSmallAlloc(size, numaNode);
+    
+    siloTraceRecordAllocation(SiloTraceOperationMalloc, size, numaNode, 0, NULL, allocatedObject, traceStartTimestamp);
+    return allocatedObject;
+}
+
+// --------
+
+void* siloMallocLocal(size_t size)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    void* allocatedObject = siloSmallAllocLocal(size);
+    
+    siloTraceRecordAllocation(SiloTraceOperationMallocLocal, size, kSiloTraceNoNode, 0, NULL, allocatedObject, traceStartTimestamp);
+    return allocatedObject;
+}
+
+// --------
+
+void siloFreeSmall(void* ptr)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    const uint64_t tracePointerId = siloTraceReleasePointerId(ptr, traceStartTimestamp);
+    
+    siloSmallFree(ptr);
+    siloTraceRecordFree(SiloTraceOperationFreeSmall, tracePointerId, traceStartTimestamp);
+}
+
+// --------
+
 void* siloMultinodeArrayAlloc(uint32_t count, const SSiloMemorySpec* spec)
 {
-    return siloOSMemoryAllocMultiNUMA(count, spec);
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    void* allocatedBuffer = siloOSMemoryAllocMultiNUMA(count, spec);
+    
+    siloTraceRecordAllocation(SiloTraceOperationMultinodeArrayAlloc, 0, kSiloTraceNoNode, count, spec, allocatedBuffer, traceStartTimestamp);
+    return allocatedBuffer;
+}
+
+// --------
+
+void* siloMultinodeArrayAllocAuto(size_t size, uint64_t nodeMask, ESiloPartitionGoal goal, uint32_t* count, SSiloMemorySpec* spec)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    std::vector<SSiloMemorySpec> plan;
+    
+    if (false == siloPartitionPlan(size, nodeMask, goal, &plan))
+    {
+        siloTraceRecordAllocation(SiloTraceOperationMultinodeArrayAlloc, size, kSiloTraceNoNode, 0, NULL, NULL, traceStartTimestamp);
+        return NULL;
+    }
+    
+    void* allocatedBuffer = siloOSMemoryAllocMultiNUMA((uint32_t)plan.size(), &plan[0]);
+    siloTraceRecordAllocation(SiloTraceOperationMultinodeArrayAlloc, size, kSiloTraceNoNode, (uint32_t)plan.size(), &plan[0], allocatedBuffer, traceStartTimestamp);
+    
+    // Report the chosen layout back to the caller.
+    if (NULL != allocatedBuffer)
+    {
+        if (NULL != count)
+            *count = (uint32_t)plan.size();
+        
+        if (NULL != spec)
+        {
+            for (size_t i = 0; i < plan.size(); ++i)
+                spec[i] = plan[i];
+        }
+    }
+    
+    return allocatedBuffer;
+}
+
+// --------
+
+void* siloSharedMultinodeArrayCreate(const char* name, uint32_t count, const SSiloMemorySpec* spec)
+{
+    if ((NULL == name) || ('\0' == name[0]))
+        return NULL;
+    
+    return siloSharedMemoryCreateMultiNUMA(name, count, spec);
+}
+
+// --------
+
+void* siloSharedMultinodeArrayAttach(const char* name, size_t* size)
+{
+    if ((NULL == name) || ('\0' == name[0]))
+        return NULL;
+    
+    return siloSharedMemoryAttachMultiNUMA(name, size);
+}
+
+// --------
+
+uint32_t siloSharedMultinodeArrayGetLayout(const char* name, uint32_t maxCount, SSiloMemorySpec* spec)
+{
+    if ((NULL == name) || ('\0' == name[0]))
+        return 0;
+    
+    return siloSharedMemoryGetLayout(name, maxCount, spec);
+}
+
+// --------
+
+int32_t siloSharedMultinodeArrayUnlink(const char* name)
+{
+    if ((NULL == name) || ('\0' == name[0]))
+        return -1;
+    
+    return (siloSharedMemoryUnlink(name) ? 0 : -1);
+}
+
+// --------
+
+int32_t siloCollapseLargePages(void* ptr)
+{
+    const std::vector<SSiloAllocationSpec>* specToCollapse = siloPointerMapRetrieve(ptr);
+    
+    if (NULL == specToCollapse)
+        return -1;
+    
+    // Collapse each piece that was allocated, continuing past failures so that as much as possible is collapsed.
+    int32_t result = 0;
+    
+    for (size_t i = 0; i < specToCollapse->size(); ++i)
+    {
+        const SSiloAllocationSpec& spec = (*specToCollapse)[i];
+        
+        if (false == siloOSMemoryCollapseLargePages(spec.ptr, spec.size))
+            result = -1;
+    }
+    
+    return result;
+}
+
+// --------
+
+size_t siloGetLargePageBackedSize(void* ptr)
+{
+    const std::vector<SSiloAllocationSpec>* specToQuery = siloPointerMapRetrieve(ptr);
+    
+    if (NULL == specToQuery)
+        return 0;
+    
+    size_t backedBytes = 0;
+    
+    for (size_t i = 0; i < specToQuery->size(); ++i)
+    {
+        const SSiloAllocationSpec& spec = (*specToQuery)[i];
+        backedBytes += siloOSMemoryGetLargePageBackedSize(spec.ptr, spec.size);
+    }
+    
+    return backedBytes;
+}
+
+// --------
+
+int32_t siloApplyHint(void* ptr, size_t size, ESiloMemoryHint hint)
+{
+    return (siloOSMemoryApplyHint(ptr, size, hint) ? 0 : -1);
+}
+
+// --------
+
+int32_t siloRelease(void* ptr, size_t size, ESiloReleaseMode mode)
+{
+    return (siloOSMemoryRelease(ptr, size, mode) ? 0 : -1);
+}
+
+// --------
+
+int32_t siloMultinodeArrayGetPiece(void* ptr, uint32_t pieceIndex, void** pieceStart, size_t* pieceSize)
+{
+    std::vector<SSiloMemorySpec> pieces;
+    
+    if ((NULL == pieceStart) || (NULL == pieceSize) || (false == siloPointerMapRetrieveLayout(ptr, &pieces)) || (pieceIndex >= pieces.size()))
+        return -1;
+    
+    size_t pieceOffset = 0;
+    for (uint32_t i = 0; i < pieceIndex; ++i)
+        pieceOffset += pieces[i].size;
+    
+    *pieceStart = (void*)((uint8_t*)ptr + pieceOffset);
+    *pieceSize = pieces[pieceIndex].size;
+    return 0;
+}
+
+// --------
+
+int32_t siloMultinodeArrayApplyHints(void* ptr, uint32_t count, const ESiloMemoryHint* hints)
+{
+    std::vector<SSiloMemorySpec> pieces;
+    
+    if ((NULL == hints) || (false == siloPointerMapRetrieveLayout(ptr, &pieces)) || (count != pieces.size()))
+        return -1;
+    
+    // Apply each hint, continuing past failures so that as many as possible are applied.
+    int32_t result = 0;
+    uint8_t* pieceStart = (uint8_t*)ptr;
+    
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if ((0 != pieces[i].size) && (false == siloOSMemoryApplyHint(pieceStart, pieces[i].size, hints[i])))
+            result = -1;
+        
+        pieceStart += pieces[i].size;
+    }
+    
+    return result;
+}
+
+// --------
+
+ESiloColoringStatus siloColoringGetStatus(void)
+{
+    return siloColorMemoryGetStatus();
+}
+
+// --------
+
+const char* siloColoringGetStatusDescription(ESiloColoringStatus status)
+{
+    switch (status)
+    {
+    case SiloColoringStatusAvailable:
+        return "Page coloring is available.";
+        
+    case SiloColoringStatusUnsupportedPlatform:
+        return "Page coloring is unavailable because this operating system does not expose physical page addresses.";
+        
+    case SiloColoringStatusNoCacheInformation:
+        return "Page coloring is unavailable because the last-level cache geometry could not be determined or the cache has only one color.";
+        
+    case SiloColoringStatusNoPhysicalAddressAccess:
+        return "Page coloring is unavailable because this process is not permitted to read physical page addresses. On Linux, run with the CAP_SYS_ADMIN capability.";
+        
+    default:
+        return "Page coloring status is unknown.";
+    }
+}
+
+// --------
+
+uint32_t siloColoringGetColorCount(void)
+{
+    return siloColorMemoryGetColorCount();
+}
+
+// --------
+
+int32_t siloColoredPoolReserve(uint32_t numaNode, size_t size)
+{
+    switch (siloColorMemoryReserve(size, numaNode))
+    {
+    case SiloColorReserveResultSuccess:
+        return 0;
+        
+    case SiloColorReserveResultCannotLock:
+        return -2;
+        
+    default:
+        return -1;
+    }
+}
+
+// --------
+
+size_t siloColoredPoolGetFreeSize(uint32_t numaNode, uint64_t colorMask)
+{
+    return siloColorMemoryGetFreeSize(numaNode, colorMask);
+}
+
+// --------
+
+void* siloColoredBufferAlloc(size_t size, uint32_t numaNode, uint64_t colorMask)
+{
+    return siloColorMemoryAlloc(size, numaNode, colorMask);
 }
 
 // --------
 
 void siloFree(void* ptr)
 {
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    const uint64_t tracePointerId = siloTraceReleasePointerId(ptr, traceStartTimestamp);
     const std::vector<SSiloAllocationSpec>* specToFree = siloPointerMapRetrieve(ptr);
 
     if (NULL == specToFree)
-        free(ptr);
+    {
+        if (false == siloColorMemoryFree(ptr))
+            free(ptr);
+    }
     else
     {
+        // Delete the metadata before freeing the memory.
+        // Otherwise another thread could be handed the same address by the operating system and fail to submit it to the map.
+        const std::vector<SSiloAllocationSpec> piecesToFree(*specToFree);
+        siloPointerMapDelete(ptr);
+        
         // Free each piece that was allocated.
-        for (size_t i = 0; i < specToFree->size(); ++i)
+        for (size_t i = 0; i < piecesToFree.size(); ++i)
         {
-            const SSiloAllocationSpec& spec = (*specToFree)[i];
+            const SSiloAllocationSpec& spec = piecesToFree[i];
             siloOSMemoryFreeNUMA(spec.ptr, spec.size);
         }
+    }
+    
+    siloTraceRecordFree(SiloTraceOperationFree, tracePointerId, traceStartTimestamp);
+}
 
-        // Delete the metadata for the just-freed allocation.
-        siloPointerMapDelete(ptr);
+// --------
+
+void siloFreeBatch(uint32_t count, void* const* ptrs)
+{
+    const uint64_t traceStartTimestamp = siloTraceGetTimestamp();
+    std::vector<uint64_t> tracePointerIds;
+    std::vector<SSiloAllocationSpec> piecesToFree;
+    std::vector<void*> unknownPtrs;
+    
+    // As with siloFree(), retire the trace identifier of each buffer before its address can be handed out again.
+    if (0 != traceStartTimestamp)
+    {
+        tracePointerIds.resize(count);
+        
+        for (uint32_t i = 0; i < count; ++i)
+            tracePointerIds[i] = ((NULL != ptrs[i]) ? siloTraceReleasePointerId(ptrs[i], traceStartTimestamp) : 0);
     }
+    
+    // As with siloFree(), delete the metadata before freeing the memory.
+    siloPointerMapDeleteBatch(count, ptrs, &piecesToFree, &unknownPtrs);
+    
+    if (false == piecesToFree.empty())
+        siloOSMemoryFreeNUMABatch((uint32_t)piecesToFree.size(), &piecesToFree[0]);
+    
+    for (size_t i = 0; i < unknownPtrs.size(); ++i)
+    {
+        if (false == siloColorMemoryFree(unknownPtrs[i]))
+            free(unknownPtrs[i]);
+    }
+    
+    // Trace each buffer as if it had been freed individually.
+    for (size_t i = 0; i < tracePointerIds.size(); ++i)
+    {
+        if (NULL != ptrs[i])
+            siloTraceRecordFree(SiloTraceOperationFree, tracePointerIds[i], traceStartTimestamp);
+    }
+}
+
+// --------
+
+int32_t siloTraceStart(const char* path)
+{
+    if (NULL == path)
+        return -1;
+    
+    return (siloTraceOpen(path) ? 0 : -1);
+}
+
+// --------
+
+void siloTraceStop(void)
+{
+    siloTraceClose();
 }
@@ -0,0 +1,455 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file smallalloc.cpp
+ *   Implementation of the NUMA-aware allocator for small objects.
+ *
+ *   Memory is obtained from the operating system in node-local chunks, each aligned to its own size so that the chunk holding any object can be found by masking the object's address.
+ *   Each chunk is divided into equally-sized spans. The first span holds the chunk header, and every other span is dedicated to a single size class.
+ *   Free objects are kept in intrusive singly-linked lists, both per thread (one per node and size class) and per node (one per size class, protected by a lock).
+ *****************************************************************************/
+
+#include "osmemory.h"
+#include "smallalloc.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <topo.h>
+#include <vector>
+
+
+// -------- CONSTANTS ------------------------------------------------------ //
+
+/// Size of each chunk of memory obtained from the operating system.
+/// Large enough that the operating system allocation functions align it to the large-page size, which is equal to this value.
+static const size_t kSiloSmallChunkSize = 2097152;
+
+/// Size of each span within a chunk.
+static const size_t kSiloSmallSpanSize = 65536;
+
+/// Number of spans in each chunk, including the span that holds the chunk header.
+static const uint32_t kSiloSmallSpansPerChunk = (uint32_t)(kSiloSmallChunkSize / kSiloSmallSpanSize);
+
+/// Number of size classes.
+static const uint32_t kSiloSmallClassCount = 40;
+
+/// Object size, in bytes, of each size class.
+/// Classes are spaced 16 bytes apart up to 128 bytes and four per power of two thereafter, which bounds internal fragmentation at 25%.
+static const uint32_t kSiloSmallClassSizes[kSiloSmallClassCount] = {
+    16,     32,     48,     64,     80,     96,     112,    128,
+    160,    192,    224,    256,    320,    384,    448,    512,
+    640,    768,    896,    1024,   1280,   1536,   1792,   2048,
+    2560,   3072,   3584,   4096,   5120,   6144,   7168,   8192,
+    10240,  12288,  14336,  16384,  20480,  24576,  28672,  32768
+};
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Stored at the start of each chunk. Identifies the owner of every object in the chunk.
+struct SSiloSmallChunkHeader
+{
+    uint32_t numaNode;                                                      ///< Zero-based index of the NUMA node that backs the chunk.
+    uint8_t spanClass[kSiloSmallSpansPerChunk];                             ///< Size class of the objects in each span.
+};
+
+/// Singly-linked list of free objects. The first bytes of each free object hold a pointer to the next.
+struct SSiloSmallFreeList
+{
+    void* head;                                                             ///< First free object, or NULL if the list is empty.
+    uint32_t count;                                                         ///< Number of objects in the list.
+};
+
+/// Holds the shared state for a single NUMA node.
+struct SSiloSmallNodeState
+{
+    std::mutex lock;                                                        ///< Guards all other fields.
+    SSiloSmallFreeList freeLists[kSiloSmallClassCount];                     ///< Central free list for each size class.
+    uint8_t* currentChunk;                                                  ///< Chunk from which new spans are taken, or NULL if none has been allocated.
+    uint32_t nextSpan;                                                      ///< Index of the next unused span in #currentChunk.
+};
+
+/// Holds the free objects cached by a single thread.
+/// Flushes everything back to the owning nodes when the thread exits.
+struct SSiloSmallThreadCache
+{
+    std::vector<SSiloSmallFreeList> freeLists;                              ///< One free list per NUMA node and size class, indexed by node first.
+
+    ~SSiloSmallThreadCache(void);
+};
+
+
+// -------- LOCALS --------------------------------------------------------- //
+
+/// Shared state for each NUMA node, indexed by zero-based NUMA node index.
+static SSiloSmallNodeState* siloSmallNodes = NULL;
+
+/// OS index of each NUMA node, indexed by zero-based NUMA node index.
+static std::vector<int32_t> siloSmallNodeOSIndices;
+
+/// Number of NUMA nodes in the system.
+static uint32_t siloSmallNodeCount = 0;
+
+/// Ensures that the shared state is initialized exactly once.
+static std::once_flag siloSmallInitializeFlag;
+
+/// Per-thread object cache.
+static thread_local SSiloSmallThreadCache siloSmallThreadCache;
+
+/// Set once the calling thread's object cache has been destroyed, after which requests bypass it and go straight to the central free lists.
+/// Trivially destructible, so it remains valid while other thread-local objects, which may still free memory, are being destroyed.
+static thread_local bool siloSmallThreadCacheIsDestroyed = false;
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+/// Initializes the shared state for all NUMA nodes.
+static void siloSmallInitialize(void)
+{
+    siloSmallNodeCount = topoGetSystemNUMANodeCount();
+    siloSmallNodes = new SSiloSmallNodeState[siloSmallNodeCount];
+    siloSmallNodeOSIndices.resize(siloSmallNodeCount);
+
+    for (uint32_t i = 0; i < siloSmallNodeCount; ++i)
+    {
+        for (uint32_t j = 0; j < kSiloSmallClassCount; ++j)
+        {
+            siloSmallNodes[i].freeLists[j].head = NULL;
+            siloSmallNodes[i].freeLists[j].count = 0;
+        }
+
+        siloSmallNodes[i].currentChunk = NULL;
+        siloSmallNodes[i].nextSpan = kSiloSmallSpansPerChunk;
+        siloSmallNodeOSIndices[i] = topoGetNUMANodeOSIndex(i);
+    }
+}
+
+// --------
+
+/// Determines the size class that serves requests of the specified size.
+/// @param [in] size Number of bytes requested, no more than #kSiloSmallMaximumSize.
+/// @return Index of the smallest size class large enough to hold `size` bytes.
+static inline uint32_t siloSmallGetSizeClass(size_t size)
+{
+    if (size <= 128)
+        return (uint32_t)((0 == size ? 0 : size - 1) / 16);
+
+    return (uint32_t)(std::lower_bound(&kSiloSmallClassSizes[8], &kSiloSmallClassSizes[kSiloSmallClassCount], (uint32_t)size) - &kSiloSmallClassSizes[0]);
+}
+
+// --------
+
+/// Determines how many objects are moved at a time between a thread cache and a node's central free list.
+/// @param [in] sizeClass Index of the size class.
+/// @return Number of objects to move.
+static inline uint32_t siloSmallGetBatchSize(uint32_t sizeClass)
+{
+    return std::max((uint32_t)4, std::min((uint32_t)64, (uint32_t)(16384 / kSiloSmallClassSizes[sizeClass])));
+}
+
+// --------
+
+/// Removes up to the specified number of objects from the front of a free list.
+/// @param [in,out] freeList List from which to remove objects.
+/// @param [in] count Maximum number of objects to remove.
+/// @param [out] removed Filled with the removed objects, still linked together.
+static void siloSmallFreeListSplit(SSiloSmallFreeList* freeList, uint32_t count, SSiloSmallFreeList* removed)
+{
+    void* tail = NULL;
+    void* current = freeList->head;
+
+    removed->head = freeList->head;
+    removed->count = 0;
+
+    while ((NULL != current) && (removed->count < count))
+    {
+        tail = current;
+        current = *(void**)current;
+        removed->count += 1;
+    }
+
+    if (NULL == tail)
+    {
+        removed->head = NULL;
+        return;
+    }
+
+    *(void**)tail = NULL;
+    freeList->head = current;
+    freeList->count -= removed->count;
+}
+
+// --------
+
+/// Adds a linked group of objects to the front of a free list.
+/// @param [in,out] freeList List to which to add objects.
+/// @param [in] added Objects to add, linked together and terminated by NULL.
+static void siloSmallFreeListPrepend(SSiloSmallFreeList* freeList, const SSiloSmallFreeList& added)
+{
+    if (0 == added.count)
+        return;
+
+    void* tail = added.head;
+
+    while (NULL != *(void**)tail)
+        tail = *(void**)tail;
+
+    *(void**)tail = freeList->head;
+    freeList->head = added.head;
+    freeList->count += added.count;
+}
+
+// --------
+
+/// Carves a new span into objects of the specified size class and adds them to the node's central free list.
+/// Must be called with the node's lock held.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] sizeClass Index of the size class.
+/// @return `true` if the span was created, `false` if memory could not be obtained from the operating system.
+static bool siloSmallCarveSpan(uint32_t numaNode, uint32_t sizeClass)
+{
+    SSiloSmallNodeState& nodeState = siloSmallNodes[numaNode];
+
+    if (kSiloSmallSpansPerChunk <= nodeState.nextSpan)
+    {
+        // Allocate a new chunk. It must be aligned to its own size for the chunk header to be found from an object's address.
+        uint8_t* newChunk = (uint8_t*)siloOSMemoryAllocNUMA(kSiloSmallChunkSize, (uint32_t)siloSmallNodeOSIndices[numaNode]);
+        if (NULL == newChunk)
+            return false;
+
+        if (0 != ((size_t)newChunk & (kSiloSmallChunkSize - 1)))
+        {
+            siloOSMemoryFreeNUMA(newChunk, kSiloSmallChunkSize);
+            return false;
+        }
+
+        SSiloSmallChunkHeader* chunkHeader = (SSiloSmallChunkHeader*)newChunk;
+        chunkHeader->numaNode = numaNode;
+
+        nodeState.currentChunk = newChunk;
+        nodeState.nextSpan = 1;
+    }
+
+    // Dedicate the next span to the requested size class and link all of its objects together.
+    SSiloSmallChunkHeader* chunkHeader = (SSiloSmallChunkHeader*)nodeState.currentChunk;
+    uint8_t* spanBase = nodeState.currentChunk + (nodeState.nextSpan * kSiloSmallSpanSize);
+    const size_t objectSize = kSiloSmallClassSizes[sizeClass];
+    const uint32_t objectCount = (uint32_t)(kSiloSmallSpanSize / objectSize);
+
+    chunkHeader->spanClass[nodeState.nextSpan] = (uint8_t)sizeClass;
+    nodeState.nextSpan += 1;
+
+    for (uint32_t i = 0; i < (objectCount - 1); ++i)
+        *(void**)(spanBase + (i * objectSize)) = (void*)(spanBase + ((i + 1) * objectSize));
+
+    *(void**)(spanBase + ((objectCount - 1) * objectSize)) = nodeState.freeLists[sizeClass].head;
+    nodeState.freeLists[sizeClass].head = (void*)spanBase;
+    nodeState.freeLists[sizeClass].count += objectCount;
+
+    return true;
+}
+
+// --------
+
+/// Moves a batch of objects from a node's central free list to a thread cache free list, creating more objects if needed.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] sizeClass Index of the size class.
+/// @param [in,out] cacheList Thread cache free list to refill.
+static void siloSmallRefill(uint32_t numaNode, uint32_t sizeClass, SSiloSmallFreeList* cacheList)
+{
+    SSiloSmallNodeState& nodeState = siloSmallNodes[numaNode];
+    SSiloSmallFreeList batch;
+
+    {
+        std::lock_guard<std::mutex> nodeLocalGuard(nodeState.lock);
+
+        if ((0 == nodeState.freeLists[sizeClass].count) && (false == siloSmallCarveSpan(numaNode, sizeClass)))
+            return;
+
+        siloSmallFreeListSplit(&nodeState.freeLists[sizeClass], siloSmallGetBatchSize(sizeClass), &batch);
+    }
+
+    siloSmallFreeListPrepend(cacheList, batch);
+}
+
+// --------
+
+/// Moves a batch of objects from a thread cache free list back to the owning node's central free list.
+/// @param [in] numaNode Zero-based index of the NUMA node that owns the objects.
+/// @param [in] sizeClass Index of the size class.
+/// @param [in,out] cacheList Thread cache free list to drain.
+/// @param [in] count Number of objects to move.
+static void siloSmallFlush(uint32_t numaNode, uint32_t sizeClass, SSiloSmallFreeList* cacheList, uint32_t count)
+{
+    SSiloSmallFreeList batch;
+    siloSmallFreeListSplit(cacheList, count, &batch);
+
+    SSiloSmallNodeState& nodeState = siloSmallNodes[numaNode];
+    std::lock_guard<std::mutex> nodeLocalGuard(nodeState.lock);
+
+    siloSmallFreeListPrepend(&nodeState.freeLists[sizeClass], batch);
+}
+
+// --------
+
+/// Takes a single object directly from a node's central free list, creating more objects if needed.
+/// Used once the calling thread's cache has been destroyed.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] sizeClass Index of the size class.
+/// @return Pointer to the object, or NULL if memory could not be obtained from the operating system.
+static void* siloSmallAllocUncached(uint32_t numaNode, uint32_t sizeClass)
+{
+    SSiloSmallNodeState& nodeState = siloSmallNodes[numaNode];
+    SSiloSmallFreeList single;
+
+    std::lock_guard<std::mutex> nodeLocalGuard(nodeState.lock);
+
+    if ((0 == nodeState.freeLists[sizeClass].count) && (false == siloSmallCarveSpan(numaNode, sizeClass)))
+        return NULL;
+
+    siloSmallFreeListSplit(&nodeState.freeLists[sizeClass], 1, &single);
+    return single.head;
+}
+
+// --------
+
+/// Returns a single object directly to a node's central free list.
+/// Used once the calling thread's cache has been destroyed.
+/// @param [in] numaNode Zero-based index of the NUMA node that owns the object.
+/// @param [in] sizeClass Index of the size class.
+/// @param [in] ptr Pointer to the object.
+static void siloSmallFreeUncached(uint32_t numaNode, uint32_t sizeClass, void* ptr)
+{
+    SSiloSmallFreeList single;
+    single.head = ptr;
+    single.count = 1;
+
+    *(void**)ptr = NULL;
+
+    SSiloSmallNodeState& nodeState = siloSmallNodes[numaNode];
+    std::lock_guard<std::mutex> nodeLocalGuard(nodeState.lock);
+
+    siloSmallFreeListPrepend(&nodeState.freeLists[sizeClass], single);
+}
+
+// --------
+
+/// Retrieves the calling thread's free list for the specified NUMA node and size class, creating the thread cache if needed.
+/// @param [in] numaNode Zero-based index of the NUMA node.
+/// @param [in] sizeClass Index of the size class.
+/// @return Pointer to the free list.
+static inline SSiloSmallFreeList* siloSmallGetCacheList(uint32_t numaNode, uint32_t sizeClass)
+{
+    if (siloSmallThreadCache.freeLists.empty())
+    {
+        SSiloSmallFreeList emptyList;
+        emptyList.head = NULL;
+        emptyList.count = 0;
+
+        siloSmallThreadCache.freeLists.assign((size_t)siloSmallNodeCount * kSiloSmallClassCount, emptyList);
+    }
+
+    return &siloSmallThreadCache.freeLists[((size_t)numaNode * kSiloSmallClassCount) + sizeClass];
+}
+
+// --------
+
+SSiloSmallThreadCache::~SSiloSmallThreadCache(void)
+{
+    siloSmallThreadCacheIsDestroyed = true;
+
+    for (size_t i = 0; i < freeLists.size(); ++i)
+    {
+        if (0 != freeLists[i].count)
+            siloSmallFlush((uint32_t)(i / kSiloSmallClassCount), (uint32_t)(i % kSiloSmallClassCount), &freeLists[i], freeLists[i].count);
+    }
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "smallalloc.h" for documentation.
+
+void* siloSmallAlloc(size_t size, uint32_t numaNode)
+{
+    std::call_once(siloSmallInitializeFlag, siloSmallInitialize);
+
+    if ((kSiloSmallMaximumSize < size) || (siloSmallNodeCount <= numaNode) || (0 > siloSmallNodeOSIndices[numaNode]))
+        return NULL;
+
+    const uint32_t sizeClass = siloSmallGetSizeClass(size);
+
+    if (true == siloSmallThreadCacheIsDestroyed)
+        return siloSmallAllocUncached(numaNode, sizeClass);
+
+    SSiloSmallFreeList* cacheList = siloSmallGetCacheList(numaNode, sizeClass);
+
+    if (0 == cacheList->count)
+    {
+        siloSmallRefill(numaNode, sizeClass, cacheList);
+
+        if (0 == cacheList->count)
+            return NULL;
+    }
+
+    void* allocatedObject = cacheList->head;
+    cacheList->head = *(void**)allocatedObject;
+    cacheList->count -= 1;
+
+    return allocatedObject;
+}
+
+// --------
+
+void* siloSmallAllocLocal(size_t size)
+{
+    std::call_once(siloSmallInitializeFlag, siloSmallInitialize);
+
+    const int32_t numaNodeOSIndex = siloOSMemoryGetCurrentNUMANode();
+
+    for (uint32_t i = 0; i < siloSmallNodeCount; ++i)
+    {
+        if (numaNodeOSIndex == siloSmallNodeOSIndices[i])
+            return siloSmallAlloc(size, i);
+    }
+
+    return NULL;
+}
+
+// --------
+
+void siloSmallFree(void* ptr)
+{
+    if (NULL == ptr)
+        return;
+
+    // Find the owner of the object using the header of the chunk that contains it.
+    const SSiloSmallChunkHeader* chunkHeader = (const SSiloSmallChunkHeader*)((size_t)ptr & ~(kSiloSmallChunkSize - 1));
+    const uint32_t spanIndex = (uint32_t)(((size_t)ptr - (size_t)chunkHeader) / kSiloSmallSpanSize);
+    const uint32_t numaNode = chunkHeader->numaNode;
+    const uint32_t sizeClass = chunkHeader->spanClass[spanIndex];
+
+    if (true == siloSmallThreadCacheIsDestroyed)
+    {
+        siloSmallFreeUncached(numaNode, sizeClass, ptr);
+        return;
+    }
+
+    // Return the object to this thread's cache for the owning node, handing a batch back to the node once the cache grows too large.
+    SSiloSmallFreeList* cacheList = siloSmallGetCacheList(numaNode, sizeClass);
+    const uint32_t batchSize = siloSmallGetBatchSize(sizeClass);
+
+    *(void**)ptr = cacheList->head;
+    cacheList->head = ptr;
+    cacheList->count += 1;
+
+    if (cacheList->count > (2 * batchSize))
+        siloSmallFlush(numaNode, sizeClass, cacheList, batchSize);
+}
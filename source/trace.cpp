@@ -0,0 +1,290 @@
+/*****************************************************************************
+ * Silo
+ *   Multi-platform topology-aware memory management library.
+ *   Supports multiple styles of NUMA-aware memory allocation.
+ *****************************************************************************
+ * Authored by Samuel Grossman
+ * Department of Electrical Engineering, Stanford University
+ * Copyright (c) 2016-2017
+ *************************************************************************//**
+ * @file trace.cpp
+ *   Implementation of the allocation tracer.
+ *   Tracing can be started programmatically or by setting the `SILO_TRACE_FILE` environment variable before the program starts.
+ *****************************************************************************/
+
+#include "osmemory.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <topo.h>
+#include <unordered_map>
+
+
+// -------- TYPE DEFINITIONS ----------------------------------------------- //
+
+/// Starts tracing when the program starts if requested by the environment, and makes sure any trace in progress is flushed when the program exits.
+struct SSiloTraceAutomaticControl
+{
+    SSiloTraceAutomaticControl(void);
+    ~SSiloTraceAutomaticControl(void);
+};
+
+
+// -------- LOCALS --------------------------------------------------------- //
+
+/// Guards all tracer state other than #siloTraceIsEnabled and #siloTraceStartTime.
+static std::mutex siloTraceLock;
+
+/// Indicates that a trace is in progress. Checked without taking the lock so that tracing costs almost nothing when disabled.
+static std::atomic<bool> siloTraceIsEnabled(false);
+
+/// File to which the trace is written.
+static FILE* siloTraceFile = NULL;
+
+/// Time at which the trace started, in nanoseconds since the epoch of the steady clock.
+/// Atomic because it is read without holding the lock by threads that may race with the start of a new trace.
+static std::atomic<int64_t> siloTraceStartTime(0);
+
+/// Maps each live traced allocation to its identifier.
+static std::unordered_map<void*, uint64_t> siloTracePointerIds;
+
+/// Identifier to assign to the next traced allocation.
+static uint64_t siloTraceNextPointerId = 1;
+
+/// Incremented each time a trace starts, so that threads can tell that their cached identifier belongs to an earlier trace.
+static std::atomic<uint32_t> siloTraceGeneration(0);
+
+/// Identifier to assign to the next thread that appears in the trace.
+static std::atomic<uint32_t> siloTraceNextThreadId(0);
+
+/// Trace generation to which #siloTraceThreadId belongs.
+static thread_local uint32_t siloTraceThreadGeneration = 0;
+
+/// Identifier of the calling thread within the current trace.
+static thread_local uint32_t siloTraceThreadId = 0;
+
+/// Starts and stops tracing automatically. Must be defined after all other tracer state.
+static SSiloTraceAutomaticControl siloTraceAutomaticControl;
+
+
+// -------- INTERNAL FUNCTIONS --------------------------------------------- //
+
+SSiloTraceAutomaticControl::SSiloTraceAutomaticControl(void)
+{
+    const char* tracePath = getenv("SILO_TRACE_FILE");
+
+    if ((NULL != tracePath) && ('\0' != tracePath[0]))
+        siloTraceOpen(tracePath);
+}
+
+// --------
+
+SSiloTraceAutomaticControl::~SSiloTraceAutomaticControl(void)
+{
+    siloTraceClose();
+}
+
+// --------
+
+/// Retrieves the identifier of the calling thread within the current trace, assigning one if needed.
+/// @return Thread identifier.
+static uint32_t siloTraceGetThreadId(void)
+{
+    const uint32_t currentGeneration = siloTraceGeneration.load();
+
+    if (currentGeneration != siloTraceThreadGeneration)
+    {
+        siloTraceThreadGeneration = currentGeneration;
+        siloTraceThreadId = siloTraceNextThreadId++;
+    }
+
+    return siloTraceThreadId;
+}
+
+// --------
+
+/// Determines the zero-based index of the NUMA node on which the calling thread is executing.
+/// @return NUMA node index, or negative if it could not be determined.
+static int32_t siloTraceGetThreadNUMANode(void)
+{
+    const int32_t numaNodeOSIndex = siloOSMemoryGetCurrentNUMANode();
+    const uint32_t numNumaNodes = topoGetSystemNUMANodeCount();
+
+    for (uint32_t i = 0; i < numNumaNodes; ++i)
+    {
+        if (numaNodeOSIndex == topoGetNUMANodeOSIndex(i))
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+// --------
+
+/// Fills in the fields common to every record.
+/// @param [in] operation Operation that was performed.
+/// @param [in] startTimestamp Value returned by siloTraceGetTimestamp() when the call began.
+/// @param [in] endTimestamp Value returned by siloTraceGetTimestamp() when the call completed.
+/// @param [out] record Record to fill.
+static void siloTraceInitializeRecord(ESiloTraceOperation operation, uint64_t startTimestamp, uint64_t endTimestamp, SSiloTraceRecord* record)
+{
+    record->operation = (uint32_t)operation;
+    record->threadId = siloTraceGetThreadId();
+    record->numaNode = kSiloTraceNoNode;
+    record->threadNumaNode = siloTraceGetThreadNUMANode();
+    record->pieceCount = 0;
+    record->reserved = 0;
+    record->size = 0;
+    record->pointerId = 0;
+    record->timestamp = startTimestamp - 1;
+    record->duration = ((endTimestamp > startTimestamp) ? (endTimestamp - startTimestamp) : 0);
+}
+
+
+// -------- FUNCTIONS ------------------------------------------------------ //
+// See "trace.h" for documentation.
+
+bool siloTraceOpen(const char* path)
+{
+    siloTraceClose();
+
+    std::lock_guard<std::mutex> siloTraceLocalGuard(siloTraceLock);
+
+    siloTraceFile = fopen(path, "wb");
+    if (NULL == siloTraceFile)
+        return false;
+
+    SSiloTraceFileHeader fileHeader;
+    fileHeader.magic = kSiloTraceMagic;
+    fileHeader.version = kSiloTraceVersion;
+    fileHeader.reserved = 0;
+
+    if (1 != fwrite(&fileHeader, sizeof(fileHeader), 1, siloTraceFile))
+    {
+        fclose(siloTraceFile);
+        siloTraceFile = NULL;
+        return false;
+    }
+
+    siloTracePointerIds.clear();
+    siloTraceNextPointerId = 1;
+    siloTraceNextThreadId = 0;
+    siloTraceGeneration += 1;
+    siloTraceStartTime.store((int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+    siloTraceIsEnabled = true;
+
+    return true;
+}
+
+// --------
+
+void siloTraceClose(void)
+{
+    std::lock_guard<std::mutex> siloTraceLocalGuard(siloTraceLock);
+
+    siloTraceIsEnabled = false;
+
+    if (NULL != siloTraceFile)
+    {
+        fclose(siloTraceFile);
+        siloTraceFile = NULL;
+    }
+
+    siloTracePointerIds.clear();
+}
+
+// --------
+
+uint64_t siloTraceGetTimestamp(void)
+{
+    if (false == siloTraceIsEnabled.load(std::memory_order_acquire))
+        return 0;
+
+    const int64_t currentTime = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    const int64_t startTime = siloTraceStartTime.load(std::memory_order_relaxed);
+
+    return ((currentTime > startTime) ? (uint64_t)(currentTime - startTime) : 0) + 1;
+}
+
+// --------
+
+void siloTraceRecordAllocation(ESiloTraceOperation operation, size_t size, uint32_t numaNode, uint32_t count, const SSiloMemorySpec* spec, void* result, uint64_t startTimestamp)
+{
+    if (0 == startTimestamp)
+        return;
+
+    const uint64_t endTimestamp = siloTraceGetTimestamp();
+
+    SSiloTraceRecord record;
+    siloTraceInitializeRecord(operation, startTimestamp, endTimestamp, &record);
+    record.numaNode = numaNode;
+    record.pieceCount = count;
+    record.size = (uint64_t)size;
+
+    std::lock_guard<std::mutex> siloTraceLocalGuard(siloTraceLock);
+
+    if (NULL == siloTraceFile)
+        return;
+
+    if (NULL != result)
+    {
+        record.pointerId = siloTraceNextPointerId++;
+        siloTracePointerIds[result] = record.pointerId;
+    }
+
+    fwrite(&record, sizeof(record), 1, siloTraceFile);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        SSiloTracePiece piece;
+        piece.size = (uint64_t)spec[i].size;
+        piece.numaNode = spec[i].numaNode;
+        piece.reserved = 0;
+
+        fwrite(&piece, sizeof(piece), 1, siloTraceFile);
+    }
+}
+
+// --------
+
+uint64_t siloTraceReleasePointerId(void* ptr, uint64_t startTimestamp)
+{
+    if (0 == startTimestamp)
+        return 0;
+
+    std::lock_guard<std::mutex> siloTraceLocalGuard(siloTraceLock);
+
+    std::unordered_map<void*, uint64_t>::iterator pointerIdIterator = siloTracePointerIds.find(ptr);
+    if (siloTracePointerIds.end() == pointerIdIterator)
+        return 0;
+
+    const uint64_t pointerId = pointerIdIterator->second;
+    siloTracePointerIds.erase(pointerIdIterator);
+
+    return pointerId;
+}
+
+// --------
+
+void siloTraceRecordFree(ESiloTraceOperation operation, uint64_t pointerId, uint64_t startTimestamp)
+{
+    // A free is only meaningful if the matching allocation is also in the trace.
+    if ((0 == startTimestamp) || (0 == pointerId))
+        return;
+
+    const uint64_t endTimestamp = siloTraceGetTimestamp();
+
+    SSiloTraceRecord record;
+    siloTraceInitializeRecord(operation, startTimestamp, endTimestamp, &record);
+    record.pointerId = pointerId;
+
+    std::lock_guard<std::mutex> siloTraceLocalGuard(siloTraceLock);
+
+    if (NULL != siloTraceFile)
+        fwrite(&record, sizeof(record), 1, siloTraceFile);
+}